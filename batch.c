@@ -0,0 +1,836 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the batch mode: many attach/extract jobs listed in a manifest,*
+ * run through a read/compute/write pipeline									*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+#include "payload.h"
+#include "compress.h"
+#include "shard.h"
+#include "batch.h"
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Shared by the stages of a batch
+struct batch_state
+{
+	batch_job_t *Job;
+	int NumJobs;
+	int NumFailed;						//Only touched by the write stage
+	const lsb_format_t *Format;			//Density of attached payloads
+	uint8_t Compress;					//Compress attached payloads
+	batch_queue_t Free;					//Buffer sets ready to be loaded
+	batch_queue_t Loaded;				//Read stage -> compute stage
+	batch_queue_t Processed;			//Compute stage -> write stage
+	batch_job_t **Active;				//Jobs read and not written yet (Depth at most)
+	int NumActive;
+	pthread_mutex_t Lock;				//Guards Active
+	pthread_cond_t Passed;				//A job left the write stage
+	uint8_t Quiet;						//No report per job
+};
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Initialize an empty queue. Returns 0 on success.
+static int queue_init(batch_queue_t *Queue, int Capacity)
+{
+	Queue->Item = malloc(Capacity * sizeof(batch_buffers_t *));
+	if(Queue->Item == NULL)
+		return -1;
+	
+	Queue->Capacity = Capacity;
+	Queue->Head = 0;
+	Queue->Count = 0;
+	Queue->Closed = 0;
+	pthread_mutex_init(&Queue->Lock, NULL);
+	pthread_cond_init(&Queue->NotEmpty, NULL);
+	pthread_cond_init(&Queue->NotFull, NULL);
+	
+	return 0;
+}
+
+/******************************************************************************/
+static void queue_destroy(batch_queue_t *Queue)
+{
+	free(Queue->Item);
+	pthread_mutex_destroy(&Queue->Lock);
+	pthread_cond_destroy(&Queue->NotEmpty);
+	pthread_cond_destroy(&Queue->NotFull);
+}
+
+/******************************************************************************/
+//Append an item, waiting while the queue is full
+static void queue_push(batch_queue_t *Queue, batch_buffers_t *Item)
+{
+	pthread_mutex_lock(&Queue->Lock);
+	
+	while(Queue->Count == Queue->Capacity)
+		pthread_cond_wait(&Queue->NotFull, &Queue->Lock);
+	
+	Queue->Item[(Queue->Head + Queue->Count) % Queue->Capacity] = Item;
+	Queue->Count++;
+	
+	pthread_cond_signal(&Queue->NotEmpty);
+	pthread_mutex_unlock(&Queue->Lock);
+}
+
+/******************************************************************************/
+//Take the oldest item, waiting while the queue is empty. Returns NULL once the
+//queue is empty and closed.
+static batch_buffers_t *queue_pop(batch_queue_t *Queue)
+{
+	batch_buffers_t *Item = NULL;
+	
+	pthread_mutex_lock(&Queue->Lock);
+	
+	while((Queue->Count == 0) && !Queue->Closed)
+		pthread_cond_wait(&Queue->NotEmpty, &Queue->Lock);
+	
+	if(Queue->Count > 0)
+	{
+		Item = Queue->Item[Queue->Head];
+		Queue->Head = (Queue->Head + 1) % Queue->Capacity;
+		Queue->Count--;
+		pthread_cond_signal(&Queue->NotFull);
+	}
+	
+	pthread_mutex_unlock(&Queue->Lock);
+	
+	return Item;
+}
+
+/******************************************************************************/
+//Wake up every consumer, the queue will not receive more items
+static void queue_close(batch_queue_t *Queue)
+{
+	pthread_mutex_lock(&Queue->Lock);
+	Queue->Closed = 1;
+	pthread_cond_broadcast(&Queue->NotEmpty);
+	pthread_mutex_unlock(&Queue->Lock);
+}
+
+/******************************************************************************/
+//Mark job as failed with a message, always returns -1
+static int fail(batch_job_t *Job, const char *Message)
+{
+	Job->Failed = 1;
+	snprintf(Job->Message, BATCH_MESSAGE_SIZE, "%s", Message);
+	return -1;
+}
+
+/******************************************************************************/
+//Read a whole file into a buffer that is grown when needed and kept otherwise
+static int read_file(const char *Filename, uint8_t **Buffer, size_t *Capacity, size_t *Size)
+{
+	struct stat		FileStat;
+	uint8_t			*NewBuffer;
+	FILE			*File;
+	
+	File = fopen(Filename, "rb");
+	if(File == NULL)
+		return -1;
+	
+	if(fstat(fileno(File), &FileStat) != 0)
+	{
+		fclose(File);
+		return -1;
+	}
+	
+	if((size_t)FileStat.st_size + 1 > *Capacity)
+	{
+		NewBuffer = realloc(*Buffer, FileStat.st_size + 1);
+		if(NewBuffer == NULL)
+		{
+			fclose(File);
+			return -1;
+		}
+		*Buffer = NewBuffer;
+		*Capacity = FileStat.st_size + 1;
+	}
+	
+	*Size = fread(*Buffer, 1, FileStat.st_size, File);
+	fclose(File);
+	
+	return (*Size == (size_t)FileStat.st_size) ? 0 : -1;
+}
+
+/******************************************************************************/
+//Write Size bytes at Offset of a file (whole new file if Offset is negative)
+static int write_file(const char *Filename, const uint8_t *Data, size_t Size, int64_t Offset)
+{
+	FILE	*File;
+	int		Result = 0;
+	
+	File = fopen(Filename, (Offset < 0) ? "wb" : "r+b");
+	if(File == NULL)
+		return -1;
+	
+	if((Offset > 0) && (fseeko(File, Offset, SEEK_SET) != 0))
+		Result = -1;
+	else if(fwrite(Data, 1, Size, File) != Size)
+		Result = -1;
+	
+	if(fclose(File) != 0)
+		Result = -1;
+	
+	return Result;
+}
+
+/******************************************************************************/
+//Decompress Size bytes into a new file
+static int write_decompressed(const char *Filename, const uint8_t *Data, size_t Size, uint64_t OriginalSize)
+{
+	decompress_stream_t		Stream;
+	FILE					*File;
+	int						Result;
+	
+	if(decompress_init(&Stream) != 0)
+		return -1;
+	
+	File = fopen(Filename, "wb");
+	Result = (File != NULL) ? decompress_feed(&Stream, Data, Size, File) : -1;
+	
+	if((decompress_end(&Stream) != 0) || (Stream.Total != OriginalSize))
+		Result = -1;
+	if((File != NULL) && (fclose(File) != 0))
+		Result = -1;
+	
+	return Result;
+}
+
+/******************************************************************************/
+//Stage 1: read the carrier (and the payload to attach) into the buffers
+static int load_job(batch_job_t *Job, batch_buffers_t *Buffers)
+{
+	size_t		PayloadSize;
+	int			Result;
+	
+	//Shard sets read and patch their carriers themselves in the compute stage
+	if(Job->Operation == 's')
+		return 0;
+	
+	if(read_file(Job->Carrier, &Buffers->File, &Buffers->FileCapacity, &Buffers->FileSize) != 0)
+		return fail(Job, "could not read carrier image");
+	
+	Result = view_BMP(Buffers->File, Buffers->FileSize, &Buffers->Img);
+	if(Result != BMP_OK)
+		return fail(Job, bmp_error(Result));
+	
+	if(Job->Operation == 'c')
+	{
+		if(read_file(Job->Payload, &Buffers->Payload, &Buffers->PayloadCapacity, &PayloadSize) != 0)
+			return fail(Job, "could not read payload file");
+		Buffers->PayloadSize = PayloadSize;
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Stage 2: attach payload to, or extract it from, the carrier in memory
+static int process_job(batch_job_t *Job, batch_buffers_t *Buffers, const lsb_format_t *Format, uint8_t Compress)
+{
+	payload_header_t	Header;
+	img24_t				*Img = &Buffers->Img;
+	uint8_t				*NewBuffer;
+	uint8_t				*Payload = Buffers->Payload;
+	uint64_t			PayloadSize = Buffers->PayloadSize;
+	int					Result;
+	
+	if(Job->Operation == 's')
+	{
+		if(shard_embed(Job->Payload, Job->Shard, Job->NumShards, Format, Compress, 1) != 0)
+			return fail(Job, "could not split payload across the carriers");
+		return 0;
+	}
+	
+	if(Job->Operation == 'c')
+	{
+		Buffers->OriginalSize = Buffers->PayloadSize;
+		Buffers->Compressed = Compress;
+		
+		if(Compress)
+		{
+			if(COMPRESS_BOUND(Buffers->PayloadSize) > Buffers->PackedCapacity)
+			{
+				NewBuffer = realloc(Buffers->Packed, COMPRESS_BOUND(Buffers->PayloadSize));
+				if(NewBuffer == NULL)
+					return fail(Job, "could not allocate memory for compression");
+				Buffers->Packed = NewBuffer;
+				Buffers->PackedCapacity = COMPRESS_BOUND(Buffers->PayloadSize);
+			}
+			
+			Payload = Buffers->Packed;
+			PayloadSize = compress_buffer(Buffers->Payload, Buffers->PayloadSize, Payload);
+		}
+		
+		if(!lsb_format_fits_layout(Format, &Img->Layout))
+			return fail(Job, "palette images take 1 bit per palette index only (no --bits or --channels)");
+		if(PayloadSize > payload_capacity(LSB_IMG_SLOTS(Img), Format))
+			return fail(Job, "payload is too big for this image");
+		
+		payload_make_header(&Header, PayloadSize, Format);
+		if(Compress)
+		{
+			Header.Flags |= PAYLOAD_COMPRESSED;
+			Header.OriginalLength = Buffers->OriginalSize;
+			payload_seal_header(&Header);
+		}
+		
+		payload_embed_img(Img, &Header, Payload, 1);
+		Buffers->PayloadSize = PayloadSize;
+		Buffers->EndSlot = payload_end_slot(&Header);
+		return 0;
+	}
+	
+	Result = payload_read_header(Img, &Header);
+	if(Result != PAYLOAD_OK)
+		return fail(Job, payload_error(Result));
+	
+	if(!payload_fits(&Header, LSB_IMG_SLOTS(Img)))
+		return fail(Job, "recorded payload length exceeds image capacity");
+	
+	if(Header.Length + 1 > Buffers->PayloadCapacity)
+	{
+		NewBuffer = realloc(Buffers->Payload, Header.Length + 1);
+		if(NewBuffer == NULL)
+			return fail(Job, "could not allocate memory for payload");
+		Buffers->Payload = NewBuffer;
+		Buffers->PayloadCapacity = Header.Length + 1;
+	}
+	
+	Buffers->PayloadSize = Header.Length;
+	Buffers->OriginalSize = (Header.Flags & PAYLOAD_COMPRESSED) ? Header.OriginalLength : Header.Length;
+	Buffers->Compressed = (Header.Flags & PAYLOAD_COMPRESSED) != 0;
+	Result = payload_extract_img(Img, &Header, Buffers->Payload, 1);
+	if(Result != PAYLOAD_OK)
+		return fail(Job, payload_error(Result));
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Stage 3: write the result. Attaching in place only rewrites the rows that hold
+//the container header and the payload.
+static int store_job(batch_job_t *Job, batch_buffers_t *Buffers)
+{
+	img24_t		*Img = &Buffers->Img;
+	uint64_t	LastRow;
+	uint64_t	FirstFileRow;
+	int			Result;
+	
+	if(Job->Operation == 's')
+	{
+		snprintf(Job->Message, BATCH_MESSAGE_SIZE, "%s split across %d carrier(s)", Job->Payload, Job->NumShards);
+		return 0;
+	}
+	
+	if((Job->Operation == 'x') && Buffers->Compressed)
+	{
+		Result = write_decompressed(Job->Payload, Buffers->Payload, Buffers->PayloadSize, Buffers->OriginalSize);
+	}
+	else if(Job->Operation == 'x')
+	{
+		Result = write_file(Job->Payload, Buffers->Payload, Buffers->PayloadSize, -1);
+	}
+	else if(Job->Output != NULL)
+	{
+		Result = write_file(Job->Output, Buffers->File, Buffers->FileSize, -1);
+	}
+	else
+	{
+		LastRow = (Buffers->EndSlot - 1) / LSB_ROW_SLOTS(Img);
+		if(LastRow >= (uint64_t)Img->Height)
+			LastRow = Img->Height - 1;
+		FirstFileRow = Img->TopDown ? (Img->Height - 1 - LastRow) : 0;
+		
+		Result = write_file(Job->Carrier, Img->Data + FirstFileRow * Img->Stride, (LastRow + 1) * Img->Stride,
+							(Img->Data - Buffers->File) + FirstFileRow * Img->Stride);
+	}
+	
+	if(Result != 0)
+		return fail(Job, Buffers->Compressed ? "could not write output file (or compressed payload is damaged)" :
+											   "could not write output file");
+	
+	snprintf(Job->Message, BATCH_MESSAGE_SIZE, "%s %" PRIu64 " bytes", (Job->Operation == 'x') ? "extracted" : "attached",
+			 Buffers->OriginalSize);
+	if(Buffers->Compressed)
+		snprintf(Job->Message + strlen(Job->Message), BATCH_MESSAGE_SIZE - strlen(Job->Message),
+				 " (compressed to %" PRIu64 " bytes)", Buffers->PayloadSize);
+	
+	return 0;
+}
+
+/******************************************************************************/
+//File number Index of a job, NULL past the last one. Written is set if the job
+//writes the file.
+static const char *job_file(const batch_job_t *Job, int Index, int *Written)
+{
+	switch(Job->Operation)
+	{
+		case 'c' :
+			//Carrier is patched in place unless there is an output file
+			*Written = (Index == 2) || ((Index == 0) && (Job->Output == NULL));
+			return (Index == 0) ? Job->Carrier : (Index == 1) ? Job->Payload : (Index == 2) ? Job->Output : NULL;
+			
+		case 'x' :
+			*Written = (Index == 1);
+			return (Index == 0) ? Job->Carrier : (Index == 1) ? Job->Payload : NULL;
+			
+		case 's' :
+			*Written = (Index > 0);
+			return (Index == 0) ? Job->Payload : (Index <= Job->NumShards) ? Job->Shard[Index - 1] : NULL;
+			
+		default :
+			return NULL;
+	}
+}
+
+/******************************************************************************/
+//Non zero if both jobs use a file one of them writes. Files are compared by the
+//name given in the manifest.
+static int jobs_conflict(const batch_job_t *A, const batch_job_t *B)
+{
+	const char	*FileA;
+	const char	*FileB;
+	int			WrittenA;
+	int			WrittenB;
+	
+	for(int i = 0; (FileA = job_file(A, i, &WrittenA)) != NULL; i++)
+	{
+		for(int j = 0; (FileB = job_file(B, j, &WrittenB)) != NULL; j++)
+		{
+			if((WrittenA || WrittenB) && (strcmp(FileA, FileB) == 0))
+				return 1;
+		}
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Read stage: loads the jobs in manifest order into free buffer sets. Waiting
+//for a free set is what keeps the number of jobs in flight bounded.
+static void *read_stage(void *Arg)
+{
+	struct batch_state	*State = Arg;
+	batch_buffers_t		*Buffers;
+	int					Conflict;
+	
+	for(int i = 0; i < State->NumJobs; i++)
+	{
+		//Every earlier job is written or still in flight. One in flight using a
+		//file this job uses (and one of them writes) has to be written first,
+		//so the manifest order holds for every file.
+		pthread_mutex_lock(&State->Lock);
+		do
+		{
+			Conflict = 0;
+			for(int k = 0; (k < State->NumActive) && !Conflict; k++)
+				Conflict = jobs_conflict(State->Active[k], &State->Job[i]);
+			if(Conflict)
+				pthread_cond_wait(&State->Passed, &State->Lock);
+		}
+		while(Conflict);
+		pthread_mutex_unlock(&State->Lock);
+		
+		Buffers = queue_pop(&State->Free);
+		Buffers->Job = &State->Job[i];
+		
+		pthread_mutex_lock(&State->Lock);
+		State->Active[State->NumActive++] = Buffers->Job;
+		pthread_mutex_unlock(&State->Lock);
+		
+		if(!Buffers->Job->Failed)
+			load_job(Buffers->Job, Buffers);
+		
+		queue_push(&State->Loaded, Buffers);
+	}
+	
+	queue_close(&State->Loaded);
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Compute stage: embeds or extracts the payload of loaded jobs
+static void *compute_stage(void *Arg)
+{
+	struct batch_state	*State = Arg;
+	batch_buffers_t		*Buffers;
+	
+	while((Buffers = queue_pop(&State->Loaded)) != NULL)
+	{
+		if(!Buffers->Job->Failed)
+			process_job(Buffers->Job, Buffers, State->Format, State->Compress);
+		
+		queue_push(&State->Processed, Buffers);
+	}
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Write stage: stores the results, reports each job and recycles its buffers
+static void *write_stage(void *Arg)
+{
+	struct batch_state	*State = Arg;
+	batch_buffers_t		*Buffers;
+	batch_job_t			*Job;
+	
+	while((Buffers = queue_pop(&State->Processed)) != NULL)
+	{
+		Job = Buffers->Job;
+		
+		if(!Job->Failed)
+			store_job(Job, Buffers);
+		
+		if(Job->Failed)
+			State->NumFailed++;
+		
+		if(!State->Quiet)
+		{
+			printf("line %d: %s %s: %s\n", Job->Line, Job->Failed ? "FAILED" : "ok",
+				   (Job->Carrier != NULL) ? Job->Carrier : "-", Job->Message);
+			fflush(stdout);
+		}
+		
+		//Jobs waiting on the files of this one can be read now
+		pthread_mutex_lock(&State->Lock);
+		for(int i = 0; i < State->NumActive; i++)
+		{
+			if(State->Active[i] == Job)
+			{
+				State->Active[i] = State->Active[--State->NumActive];
+				break;
+			}
+		}
+		pthread_cond_signal(&State->Passed);
+		pthread_mutex_unlock(&State->Lock);
+		
+		queue_push(&State->Free, Buffers);
+	}
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Parse the manifest into a job list. Invalid lines become failed jobs.
+static int read_manifest(const char *ManifestName, batch_job_t **JobList)
+{
+	FILE			*Manifest;
+	char			Line[BATCH_MAX_LINE];
+	char			*Field[BATCH_MAX_LINE / 2];
+	char			*Save;
+	int				NumFields;
+	int				NumJobs = 0;
+	int				LineNumber = 0;
+	batch_job_t		*Job = NULL;
+	batch_job_t		*NewJob;
+	
+	Manifest = fopen(ManifestName, "r");
+	if(Manifest == NULL)
+		return -1;
+	
+	while(fgets(Line, sizeof(Line), Manifest) != NULL)
+	{
+		LineNumber++;
+		
+		//Strip comments, split fields on blanks
+		if(strchr(Line, '#') != NULL)
+			*strchr(Line, '#') = '\0';
+		
+		NumFields = 0;
+		for(char *Token = strtok_r(Line, " \t\r\n", &Save); Token != NULL; Token = strtok_r(NULL, " \t\r\n", &Save))
+		{
+			Field[NumFields++] = Token;
+		}
+		
+		if(NumFields == 0)
+			continue;
+		
+		NewJob = realloc(Job, (NumJobs + 1) * sizeof(batch_job_t));
+		if(NewJob == NULL)
+			break;
+		Job = NewJob;
+		
+		memset(&Job[NumJobs], 0, sizeof(batch_job_t));
+		Job[NumJobs].Line = LineNumber;
+		
+		if((strcmp(Field[0], "c") == 0) && ((NumFields == 3) || (NumFields == 4)))
+			Job[NumJobs].Operation = 'c';
+		else if((strcmp(Field[0], "x") == 0) && (NumFields == 3))
+			Job[NumJobs].Operation = 'x';
+		else if((strcmp(Field[0], "s") == 0) && (NumFields >= 3) && (NumFields - 2 <= SHARD_MAX_COUNT))
+			Job[NumJobs].Operation = 's';
+		else
+			fail(&Job[NumJobs], "invalid manifest line (expected: c carrier payload [output] | x carrier payload | "
+								"s payload carrier [...])");
+		
+		if(Job[NumJobs].Operation == 's')
+		{
+			Job[NumJobs].Payload = strdup(Field[1]);
+			Job[NumJobs].Carrier = strdup(Field[2]);
+			Job[NumJobs].Shard = malloc((NumFields - 2) * sizeof(char *));
+			if(Job[NumJobs].Shard == NULL)
+			{
+				fail(&Job[NumJobs], "could not allocate memory for the shard set");
+			}
+			else
+			{
+				for(int i = 2; i < NumFields; i++)
+					Job[NumJobs].Shard[Job[NumJobs].NumShards++] = strdup(Field[i]);
+			}
+		}
+		else if(Job[NumJobs].Operation != 0)
+		{
+			Job[NumJobs].Carrier = strdup(Field[1]);
+			Job[NumJobs].Payload = strdup(Field[2]);
+			Job[NumJobs].Output = (NumFields == 4) ? strdup(Field[3]) : NULL;
+		}
+		
+		NumJobs++;
+	}
+	
+	fclose(Manifest);
+	
+	*JobList = Job;
+	return NumJobs;
+}
+
+
+/******************************************************************************/
+//Run the jobs of the state through the pipeline, filling NumFailed
+static void run_pipeline(struct batch_state *State, int NumWorkers, int Depth)
+{
+	batch_buffers_t		*Buffers;
+	pthread_t			Reader;
+	pthread_t			Writer;
+	pthread_t			*Worker;
+	int					NumStarted = 0;
+	
+	State->NumFailed = 0;
+	State->NumActive = 0;
+	
+	if(NumWorkers > State->NumJobs)
+		NumWorkers = (State->NumJobs > 0) ? State->NumJobs : 1;
+	if(Depth < 1)
+		Depth = BATCH_DEFAULT_DEPTH(NumWorkers);
+	
+	//Every queue can hold all buffer sets, so only the free queue ever blocks
+	Buffers = calloc(Depth, sizeof(batch_buffers_t));
+	Worker = malloc(NumWorkers * sizeof(pthread_t));
+	State->Active = malloc(Depth * sizeof(batch_job_t *));
+	if((Buffers == NULL) || (Worker == NULL) || (State->Active == NULL) || (queue_init(&State->Free, Depth) != 0) ||
+	   (queue_init(&State->Loaded, Depth) != 0) || (queue_init(&State->Processed, Depth) != 0))
+	{
+		printf("Could not allocate memory for the batch pipeline!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	pthread_mutex_init(&State->Lock, NULL);
+	pthread_cond_init(&State->Passed, NULL);
+	
+	for(int i = 0; i < Depth; i++)
+		queue_push(&State->Free, &Buffers[i]);
+	
+	if((pthread_create(&Reader, NULL, read_stage, State) != 0) ||
+	   (pthread_create(&Writer, NULL, write_stage, State) != 0))
+	{
+		printf("Could not start the batch pipeline threads!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(int i = 0; i < NumWorkers; i++)
+	{
+		if(pthread_create(&Worker[NumStarted], NULL, compute_stage, State) == 0)
+			NumStarted++;
+	}
+	
+	//Without any worker thread the compute stage runs on the calling thread
+	if(NumStarted == 0)
+		compute_stage(State);
+	
+	//Writer ends once every compute worker is done and its queue is drained
+	for(int i = 0; i < NumStarted; i++)
+		pthread_join(Worker[i], NULL);
+	queue_close(&State->Processed);
+	
+	pthread_join(Reader, NULL);
+	pthread_join(Writer, NULL);
+	
+	for(int i = 0; i < Depth; i++)
+	{
+		free(Buffers[i].File);
+		free(Buffers[i].Payload);
+		free(Buffers[i].Packed);
+		free(Buffers[i].Img.Pixel);
+	}
+	free(Buffers);
+	free(Worker);
+	free(State->Active);
+	queue_destroy(&State->Free);
+	queue_destroy(&State->Loaded);
+	queue_destroy(&State->Processed);
+	pthread_mutex_destroy(&State->Lock);
+	pthread_cond_destroy(&State->Passed);
+}
+
+/******************************************************************************/
+static void free_jobs(batch_job_t *Job, int NumJobs)
+{
+	for(int i = 0; i < NumJobs; i++)
+	{
+		free(Job[i].Carrier);
+		free(Job[i].Payload);
+		free(Job[i].Output);
+		for(int j = 0; j < Job[i].NumShards; j++)
+			free(Job[i].Shard[j]);
+		free(Job[i].Shard);
+	}
+	free(Job);
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Run every job of the manifest through the read/compute/write pipeline
+int batch_run(const char *ManifestName, int NumWorkers, int Depth, const lsb_format_t *Format, uint8_t Compress)
+{
+	struct batch_state	State;
+	
+	State.NumJobs = read_manifest(ManifestName, &State.Job);
+	if(State.NumJobs < 0)
+		return -1;
+	
+	State.Format = Format;
+	State.Compress = Compress;
+	State.Quiet = 0;
+	
+	run_pipeline(&State, NumWorkers, Depth);
+	
+	printf("%d jobs, %d failed\n", State.NumJobs, State.NumFailed);
+	
+	free_jobs(State.Job, State.NumJobs);
+	
+	return State.NumFailed;
+}
+
+/******************************************************************************/
+//Attach then extract on the same carriers, listed one after the other
+int batch_self_test(void)
+{
+	const lsb_format_t	Format = {1, LSB_ALL_CHANNELS};
+	const int			NumCarriers = 16;
+	const int			NumRounds = 8;
+	const size_t		PayloadSize = 1000;
+	
+	struct batch_state	State;
+	char				Directory[] = "/tmp/steg_batch_XXXXXX";
+	char				Name[sizeof(Directory) + 32];
+	uint8_t				*Payload = malloc(PayloadSize);
+	uint8_t				*Output = NULL;
+	size_t				OutputCapacity = 0;
+	size_t				OutputSize;
+	img24_t				*Img;
+	FILE				*File;
+	int					Failed = 0;
+	
+	printf("Batch file order  ... ");
+	if((Payload == NULL) || (mkdtemp(Directory) == NULL))
+	{
+		printf("could not create test files\n");
+		free(Payload);
+		return -1;
+	}
+	
+	for(size_t i = 0; i < PayloadSize; i++)
+		Payload[i] = rand();
+	snprintf(Name, sizeof(Name), "%s/payload", Directory);
+	File = fopen(Name, "wb");
+	if(File != NULL)
+	{
+		fwrite(Payload, 1, PayloadSize, File);
+		fclose(File);
+	}
+	
+	//Every carrier gets "c carrier payload" then "x carrier output", so each
+	//extraction reads a carrier an attach still in flight is writing
+	for(int Round = 0; (Round < NumRounds) && !Failed; Round++)
+	{
+		State.NumJobs = 2 * NumCarriers;
+		State.Job = calloc(State.NumJobs, sizeof(batch_job_t));
+		State.Format = &Format;
+		State.Compress = 0;
+		State.Quiet = 1;
+		if(State.Job == NULL)
+		{
+			Failed = 1;
+			break;
+		}
+		
+		for(int i = 0; i < NumCarriers; i++)
+		{
+			snprintf(Name, sizeof(Name), "%s/carrier%d.bmp", Directory, i);
+			Img = create_img(64, 64);
+			save_BMP(Img, Name);
+			free_img(Img);
+			
+			State.Job[2 * i].Line = 2 * i + 1;
+			State.Job[2 * i].Operation = 'c';
+			State.Job[2 * i].Carrier = strdup(Name);
+			snprintf(Name, sizeof(Name), "%s/payload", Directory);
+			State.Job[2 * i].Payload = strdup(Name);
+			
+			State.Job[2 * i + 1].Line = 2 * i + 2;
+			State.Job[2 * i + 1].Operation = 'x';
+			State.Job[2 * i + 1].Carrier = strdup(State.Job[2 * i].Carrier);
+			snprintf(Name, sizeof(Name), "%s/output%d", Directory, i);
+			State.Job[2 * i + 1].Payload = strdup(Name);
+		}
+		
+		run_pipeline(&State, 4, 0);
+		
+		for(int i = 0; (i < NumCarriers) && !Failed; i++)
+		{
+			Failed = (State.NumFailed != 0) ||
+					 (read_file(State.Job[2 * i + 1].Payload, &Output, &OutputCapacity, &OutputSize) != 0) ||
+					 (OutputSize != PayloadSize) || (memcmp(Output, Payload, PayloadSize) != 0);
+		}
+		
+		for(int i = 0; i < State.NumJobs; i++)
+			remove((State.Job[i].Operation == 'c') ? State.Job[i].Carrier : State.Job[i].Payload);
+		free_jobs(State.Job, State.NumJobs);
+	}
+	
+	snprintf(Name, sizeof(Name), "%s/payload", Directory);
+	remove(Name);
+	rmdir(Directory);
+	free(Payload);
+	free(Output);
+	
+	printf("%s\n", Failed ? "FAILED" : "OK");
+	
+	return Failed ? -1 : 0;
+}
@@ -0,0 +1,111 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the batch mode: many attach/extract jobs listed    *
+ * in a manifest, run through a read/compute/write pipeline          *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Manifest format, one job per line (blank lines and '#' comments are skipped):
+//  c <carrier> <payload> [output]   attach payload (in place without output)
+//  x <carrier> <payload>            extract payload from carrier
+//  s <payload> <carrier> [...]      split payload across carriers, in place
+
+//Longest manifest line
+#define BATCH_MAX_LINE		4096
+
+//Size of the job status message
+#define BATCH_MESSAGE_SIZE	192
+
+//Default pipeline depth (jobs in flight) for a number of compute workers:
+//one job per worker plus one being read and one being written
+#define BATCH_DEFAULT_DEPTH(NumWorkers)	((NumWorkers) + 2)
+
+/*******************************************************************************
+ *                                   STRUCTURES                                *
+ *******************************************************************************/
+
+//One manifest line
+struct batch_job
+{
+	int Line;							//Line number in the manifest
+	char Operation;						//'c' attach, 'x' extract, 's' shard, 0 invalid line
+	char *Carrier;						//First carrier of a shard set
+	char *Payload;
+	char *Output;						//NULL: attach in place
+	char **Shard;						//Carriers of a shard set
+	int NumShards;
+	int Failed;
+	char Message[BATCH_MESSAGE_SIZE];	//Job status
+};
+
+//Buffers of one job in flight, reused from job to job
+struct batch_buffers
+{
+	struct batch_job *Job;				//Job currently using the buffers
+	uint8_t *File;						//Whole carrier file
+	size_t FileCapacity;
+	size_t FileSize;
+	uint8_t *Payload;
+	size_t PayloadCapacity;
+	uint64_t PayloadSize;				//Bytes stored in the image
+	uint64_t OriginalSize;				//Payload bytes before compression
+	uint8_t Compressed;
+	uint8_t *Packed;					//Compressed payload to attach
+	size_t PackedCapacity;
+	uint64_t EndSlot;					//First slot after an attached payload
+	img24_t Img;						//View over File
+};
+
+//Bounded FIFO of buffer sets between two pipeline stages
+struct batch_queue
+{
+	struct batch_buffers **Item;
+	int Capacity;
+	int Head;
+	int Count;
+	int Closed;							//No more items will be pushed
+	pthread_mutex_t Lock;
+	pthread_cond_t NotEmpty;
+	pthread_cond_t NotFull;
+};
+
+typedef struct batch_job			batch_job_t;
+typedef struct batch_buffers		batch_buffers_t;
+typedef struct batch_queue			batch_queue_t;
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Run every job of the manifest through a three stage pipeline: one thread
+//reads carriers, NumWorkers threads embed/extract and one thread writes the
+//results. At most Depth jobs are in flight, which bounds the memory used.
+//Payloads are attached with the density Format, compressed first if Compress
+//is set. A job using a file an earlier one writes (or writing a file an earlier
+//one uses) is only read once that job is written. Failed jobs do not stop the
+//batch. Returns the number of failed jobs, or -1 if the manifest could not be
+//read.
+int batch_run(const char *ManifestName, int NumWorkers, int Depth, const lsb_format_t *Format, uint8_t Compress);
+//------------------------------------------------------------------------------
+//Check that jobs sharing a file keep the manifest order: an extraction listed
+//after an attach to the same carrier finds the payload. Returns 0 on success.
+int batch_self_test(void);
+
+
+#endif
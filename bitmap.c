@@ -10,10 +10,300 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>		//To sue precise data types (uint8_t, uint16_t ...)
+#include <string.h>
+
+#include <fcntl.h>		//Memory mapped image files (open, mmap, fstat)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "bitmap.h"
 
 
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Point Pixel[row] to the rows of Data. Row 0 is always the bottom row of the
+//image, whatever the row order of the pixel matrix in Data is.
+static void link_rows(img24_t *Img)
+{
+	for(int32_t row = 0; row < Img->Height; row++)
+	{
+		if(Img->TopDown)
+			Img->Pixel[row] = (pixel24_t *)(Img->Data + (size_t)(Img->Height - 1 - row) * Img->Stride);
+		else
+			Img->Pixel[row] = (pixel24_t *)(Img->Data + (size_t)row * Img->Stride);
+	}
+}
+
+/******************************************************************************/
+//Allocate an image of Stride bytes per row, pixel matrix left uninitialized
+static img24_t *alloc_img(int32_t Width, int32_t Height, uint32_t Stride, const pixel_layout_t *Layout)
+{
+	img24_t		*Img;
+	size_t		SizePixelMatrix;
+	
+	Img = malloc(sizeof(img24_t));
+	if(Img == NULL)
+	{
+		printf("Error: could not allocate memory for image\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	Img->Width = Width;
+	Img->Height = Height;
+	Img->Stride = Stride;
+	Img->TopDown = 0;
+	Img->Layout = *Layout;
+	Img->Headers = NULL;
+	Img->HeadersSize = 0;
+	Img->Map = NULL;
+	Img->MapSize = 0;
+	
+	//aligned_alloc() requires a size multiple of the alignment
+	SizePixelMatrix = (size_t)Stride * Height;
+	SizePixelMatrix = (SizePixelMatrix + IMG_ALIGNMENT - 1) & ~((size_t)IMG_ALIGNMENT - 1);
+	
+	Img->Data = aligned_alloc(IMG_ALIGNMENT, SizePixelMatrix);
+	Img->Pixel = malloc(Height * sizeof(pixel24_t *));
+	if((Img->Data == NULL) || (Img->Pixel == NULL))
+	{
+		printf("Error: could not allocate memory for %d by %d pixel matrix\n\n", Width, Height);
+		exit(EXIT_FAILURE);
+	}
+	
+	return Img;
+}
+
+
+/******************************************************************************/
+//Closest color of the other index parity for every color of a palette of
+//NumColors colors. Returns -1 if there is no such color.
+static int find_nearest(const uint8_t *Palette, uint32_t NumColors, uint8_t *Nearest)
+{
+	uint32_t	Distance;
+	uint32_t	Best;
+	int			Delta;
+	
+	if(NumColors < 2)
+		return -1;
+	
+	//Indexes past the palette should not appear, they just get the other bit
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		Nearest[i] = i ^ 1;
+		Best = UINT32_MAX;
+		for(uint32_t j = (i & 1) ^ 1; (i < NumColors) && (j < NumColors); j += 2)
+		{
+			Distance = 0;
+			for(unsigned Channel = 0; Channel < 3; Channel++)
+			{
+				Delta = (int)Palette[4 * i + Channel] - Palette[4 * j + Channel];
+				Distance += Delta * Delta;
+			}
+			
+			if(Distance < Best)
+			{
+				Best = Distance;
+				Nearest[i] = j;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Find where the channels are in the pixels, for the pixel formats that can
+//carry a payload: 24 bpp, 32 bpp (BGRX, or 8 bit color masks on byte
+//boundaries) and 8 bpp with a palette of at least 2 colors. SlotsPerPixel is 0
+//for the others. Palette holds the palette of 8 bpp images.
+static void find_layout(const bmp_headerV3_t *BMPHeader, const uint8_t *Palette, pixel_layout_t *Layout)
+{
+	uint32_t	Mask[3] = {BMPHeader->BlueMask, BMPHeader->GreenMask, BMPHeader->RedMask};
+	uint32_t	NumColors = (BMPHeader->NumColorsInTable > 0) ? BMPHeader->NumColorsInTable : 256;
+	
+	memset(Layout, 0, sizeof(pixel_layout_t));
+	
+	if((BMPHeader->ColorDepth == 24) && (BMPHeader->Compression == BMP_RGB))
+	{
+		Layout->BytesPerPixel = 3;
+		Layout->SlotsPerPixel = 3;
+		Layout->Offset[1] = 1;
+		Layout->Offset[2] = 2;
+	}
+	else if((BMPHeader->ColorDepth == 8) && (BMPHeader->Compression == BMP_RGB))
+	{
+		if(find_nearest(Palette, NumColors, Layout->Nearest) != 0)
+			return;
+		
+		Layout->BytesPerPixel = 1;
+		Layout->SlotsPerPixel = 1;
+	}
+	else if((BMPHeader->ColorDepth == 32) && (BMPHeader->Compression == BMP_RGB))
+	{
+		Layout->BytesPerPixel = 4;
+		Layout->SlotsPerPixel = 3;
+		Layout->Offset[1] = 1;
+		Layout->Offset[2] = 2;
+	}
+	else if((BMPHeader->ColorDepth == 32) &&
+			((BMPHeader->Compression == BMP_BITFIELDS) || (BMPHeader->Compression == BMP_ALPHABITFIELDS)))
+	{
+		//Each channel must fill a byte of its own
+		for(unsigned Channel = 0; Channel < 3; Channel++)
+		{
+			for(Layout->Offset[Channel] = 0; Layout->Offset[Channel] < 4; Layout->Offset[Channel]++)
+			{
+				if(Mask[Channel] == (uint32_t)0xFF << (8 * Layout->Offset[Channel]))
+					break;
+			}
+			if(Layout->Offset[Channel] == 4)
+				return;
+		}
+		
+		if((Mask[0] & Mask[1]) || (Mask[0] & Mask[2]) || (Mask[1] & Mask[2]))
+			return;
+		
+		Layout->BytesPerPixel = 4;
+		Layout->SlotsPerPixel = 3;
+	}
+}
+
+/******************************************************************************/
+//Validate file header and the BMP header and fill the image dimensions. Only
+//the V1 part of the BMP header (common to all header versions), the color
+//masks that follow it and the palette of 8 bpp images (BMP_PALETTE_SIZE bytes)
+//are needed. Returns BMP_OK or an error code.
+static int parse_headers(const file_header_t *FileHeader, const bmp_headerV3_t *BMPHeader, const uint8_t *Palette,
+						 dimensions_t *Dimension)
+{
+	uint64_t	Tables = 0;
+	
+	if((FileHeader->CharID_1 != 0x42) || (FileHeader->CharID_2 != 0x4D))
+		return BMP_ERROR_ID;
+	
+	switch(BMPHeader->SizeHeader)
+	{
+		case BITMAP_V1_INFOHEADER :
+		case BITMAP_V2_INFOHEADER :
+		case BITMAP_V3_INFOHEADER :
+		case BITMAP_V4_INFOHEADER :
+		case BITMAP_V5_INFOHEADER :
+			break;
+			
+		default :
+			return BMP_ERROR_HEADER;
+	}
+	
+	//Color masks after a V1 header, palette of 8 bpp images (all colors if 0)
+	if((BMPHeader->SizeHeader == BITMAP_V1_INFOHEADER) && (BMPHeader->Compression == BMP_BITFIELDS))
+		Tables = 3 * sizeof(uint32_t);
+	else if((BMPHeader->SizeHeader == BITMAP_V1_INFOHEADER) && (BMPHeader->Compression == BMP_ALPHABITFIELDS))
+		Tables = 4 * sizeof(uint32_t);
+	if((BMPHeader->ColorDepth == 8) && (BMPHeader->NumColorsInTable > 256))
+		return BMP_ERROR_HEADER;
+	if(BMPHeader->ColorDepth == 8)
+		Tables = 4 * ((BMPHeader->NumColorsInTable > 0) ? BMPHeader->NumColorsInTable : 256);
+	
+	if(FileHeader->OffsetPixelMatrix < sizeof(file_header_t) + BMPHeader->SizeHeader + Tables)
+		return BMP_ERROR_HEADER;
+	
+	//No format carrying a payload has more than 32 bits per pixel
+	if(BMPHeader->ColorDepth > 32)
+		return BMP_ERROR_FORMAT;
+	
+	if((BMPHeader->Width < 1) || (BMPHeader->Width > BMP_MAX_WIDTH) ||
+	   (BMPHeader->Height == 0) || (BMPHeader->Height == INT32_MIN))
+		return BMP_ERROR_DIMENSIONS;
+	
+	//Negative height means top-down row order
+	Dimension->Width = BMPHeader->Width;
+	Dimension->Height = (BMPHeader->Height < 0) ? -BMPHeader->Height : BMPHeader->Height;
+	Dimension->TopDown = (BMPHeader->Height < 0);
+	Dimension->ColorDepth = BMPHeader->ColorDepth;
+	Dimension->Compression = BMPHeader->Compression;
+	Dimension->OffsetPixelMatrix = FileHeader->OffsetPixelMatrix;
+	Dimension->Stride = ROW_SIZE_BPP(BMPHeader->Width, BMPHeader->ColorDepth);
+	find_layout(BMPHeader, Palette, &Dimension->Layout);
+	
+	return BMP_OK;
+}
+
+/******************************************************************************/
+//Check that the pixel matrix of an open image file fits in the file, without
+//reading it. Returns BMP_OK or BMP_ERROR_TRUNCATED.
+static int check_file_size(FILE *Image, const dimensions_t *Dimension)
+{
+	struct stat	Status;
+	
+	//Only regular files have a size to check against
+	if((fstat(fileno(Image), &Status) != 0) || !S_ISREG(Status.st_mode))
+		return BMP_OK;
+	
+	if(Dimension->OffsetPixelMatrix + (uint64_t)Dimension->Stride * Dimension->Height > (uint64_t)Status.st_size)
+		return BMP_ERROR_TRUNCATED;
+	
+	return BMP_OK;
+}
+
+/******************************************************************************/
+//Read the file header, the V1 part of the BMP header, the color masks that
+//may follow it and the palette of 8 bpp images (BMP_PALETTE_SIZE bytes), left
+//zero if the file is shorter. Returns BMP_OK or an error code.
+static int read_headers(FILE *Image, file_header_t *FileHeader, bmp_headerV3_t *BMPHeader, uint8_t *Palette)
+{
+	memset(BMPHeader, 0, sizeof(bmp_headerV3_t));
+	memset(Palette, 0, BMP_PALETTE_SIZE);
+	
+	if((fread(FileHeader, sizeof(file_header_t), 1, Image) != 1) ||
+	   (fread(BMPHeader, sizeof(bmp_headerV1_t), 1, Image) != 1))
+		return BMP_ERROR_READ;
+	
+	//Masks are only used for formats that have them
+	if(fread((uint8_t *)BMPHeader + sizeof(bmp_headerV1_t), 1, sizeof(bmp_headerV3_t) - sizeof(bmp_headerV1_t),
+			 Image) == 0)
+		clearerr(Image);
+	
+	if((BMPHeader->ColorDepth == 8) &&
+	   ((fseeko(Image, sizeof(file_header_t) + (off_t)BMPHeader->SizeHeader, SEEK_SET) != 0) ||
+		(fread(Palette, 1, BMP_PALETTE_SIZE, Image) == 0)))
+		clearerr(Image);
+	
+	return BMP_OK;
+}
+
+/******************************************************************************/
+//Report the error of a function returning BMP_* results and end the program
+static void check_result(int Result)
+{
+	switch(Result)
+	{
+		case BMP_OK :
+			return;
+		
+		case BMP_ERROR_ID :
+			printf("Error: input file is not a BMP image or have incompatible BMP file identifier. (should be: \"BM\")\n");
+			break;
+		
+		case BMP_ERROR_HEADER :
+			printf("Error: bitmap header is not supported. Suported bitmap headers for reading:\n");
+			printf("       - BITMAPIFOHEADER     (V1)\n");
+			printf("       - BITMAPV2INFOHEADER  (V2)\n");
+			printf("       - BITMAPV3INFOHEADER  (V3)\n");
+			printf("       - BITMAPV4HEADER      (V4)\n");
+			printf("       - BITMAPV5HEADER      (V5)\n");
+			break;
+		
+		default :
+			printf("Error: %s\n\n", bmp_error(Result));
+	}
+	
+	exit(EXIT_FAILURE);
+}
+
+
 /*******************************************************************************
  *                              FUNCTION DEFINITIONS                           *
  *******************************************************************************/
@@ -23,10 +313,25 @@ void save_BMP(img24_t *Img, const char *Filename)
 {
 	file_header_t	FileHeader;
 	bmp_headerV1_t	BMPHeaderV1;
-	uint8_t			ByteZero = 0;
-	int32_t 		SizeWidthByte;
-	int32_t			TotalWidthMod4;
-
+	size_t			SizePixelMatrix;
+	FILE			*ImageFile;
+	
+	//Images read from a file go back with their own headers and pixel format
+	if(Img->Headers != NULL)
+	{
+		ImageFile = fopen(Filename, "wb");
+		SizePixelMatrix = (size_t)Img->Stride * Img->Height;
+		if((ImageFile == NULL) || (fwrite(Img->Headers, 1, Img->HeadersSize, ImageFile) != Img->HeadersSize) ||
+		   (fwrite(Img->Data, 1, SizePixelMatrix, ImageFile) != SizePixelMatrix))
+		{
+			printf("Error: problem ocurred while writing image file\n\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		fclose(ImageFile);
+		return;
+	}
+	
 	//evaluate image dimensions
 	if((Img->Width > 20000)||(Img->Height > 20000))
 	{
@@ -39,7 +344,7 @@ void save_BMP(img24_t *Img, const char *Filename)
 		printf("Error: Dimensions for image creation should be equal or greater than 2 by 2\n\n");
 		exit(EXIT_FAILURE);
 	}
-
+	
 	FileHeader.CharID_1 = 0x42;
 	FileHeader.CharID_2 = 0x4D;
 	FileHeader.Reserved_1 = 0;
@@ -48,7 +353,7 @@ void save_BMP(img24_t *Img, const char *Filename)
 	
 	BMPHeaderV1.SizeHeader = 40;
 	BMPHeaderV1.Width = Img->Width;
-	BMPHeaderV1.Height = Img->Height;
+	BMPHeaderV1.Height = Img->TopDown ? -Img->Height : Img->Height;
 	BMPHeaderV1.Planes = 1;
 	BMPHeaderV1.ColorDepth = 24;
 	BMPHeaderV1.Compression = 0;
@@ -56,24 +361,15 @@ void save_BMP(img24_t *Img, const char *Filename)
 	BMPHeaderV1.ResolutionY = RESOLUTION_Y;
 	BMPHeaderV1.NumColorsInTable = 0;
 	BMPHeaderV1.NumImportantColors = 0;
-
-	//Finding pixel matrix size and adding padding
-	SizeWidthByte = Img->Width * 3;			//size of one line in bytes
-	TotalWidthMod4 = SizeWidthByte % 4;
 	
-	if(TotalWidthMod4 != 0)
-	{
-		SizeWidthByte = SizeWidthByte + 4 - TotalWidthMod4;
-	}
+	//Pixel matrix is stored in memory with the same padded rows as the file
+	SizePixelMatrix = (size_t)Img->Stride * Img->Height;
+	BMPHeaderV1.SizePixelMatrix = SizePixelMatrix;
 	
-	BMPHeaderV1.SizePixelMatrix = SizeWidthByte * Img->Height;
-
 	//Finding total image file size
 	FileHeader.FileSize = 54 + BMPHeaderV1.SizePixelMatrix;
-
-	//Opening image file
-	FILE *ImageFile;
 	
+	//Opening image file
 	ImageFile = fopen(Filename, "wb");
 	if(ImageFile == NULL)
 	{
@@ -85,29 +381,12 @@ void save_BMP(img24_t *Img, const char *Filename)
 	fwrite(&FileHeader, sizeof(file_header_t), 1, ImageFile);
 	fwrite(&BMPHeaderV1, sizeof(bmp_headerV1_t), 1, ImageFile);
 	
-	//Writing image
-	for(int32_t row = 0; row < Img->Height; row++)
+	//Writing image. Padding bytes are kept zeroed in memory, so the whole pixel
+	//matrix goes out in a single call
+	if(fwrite(Img->Data, 1, SizePixelMatrix, ImageFile) != SizePixelMatrix)
 	{
-		for(int32_t column = 0; column < Img->Width; column++)
-		{
-			fwrite(&Img->Pixel[row][column], sizeof(pixel24_t), 1, ImageFile);
-			
-			if(column == (Img->Width - 1))
-			{
-				if(TotalWidthMod4 == 1)
-				{
-					fwrite(&ByteZero, sizeof(uint8_t), 3, ImageFile);
-					
-				}else if(TotalWidthMod4 == 2)
-				{
-					fwrite(&ByteZero, sizeof(uint8_t), 2, ImageFile);
-					
-				}else if(TotalWidthMod4 == 3)
-				{
-					fwrite(&ByteZero, sizeof(uint8_t), 1, ImageFile);
-				}
-			}
-		}
+		printf("Error: problem ocurred while writing image file\n\n");
+		exit(EXIT_FAILURE);
 	}
 	
 	fclose(ImageFile);
@@ -118,15 +397,14 @@ void save_BMP(img24_t *Img, const char *Filename)
 img24_t *read_BMP(const char *Filename)
 {
 	file_header_t	FileHeader;
-	bmp_headerV1_t	BMPHeaderV1;
-	bmp_headerV2_t	BMPHeaderV2;
-	bmp_headerV3_t	BMPHeaderV3;
-	bmp_headerV4_t	BMPHeaderV4;
-	bmp_headerV5_t	BMPHeaderV5;
+	bmp_headerV3_t	BMPHeader;
+	uint8_t			Palette[BMP_PALETTE_SIZE];
+	dimensions_t	Dimension;
 	
 	img24_t			*Img;
-
-	uint8_t 		Trash;
+	
+	size_t			SizeWidthByte;
+	size_t			SizePixelMatrix;
 	
 	FILE 			*Image;
 	
@@ -138,91 +416,51 @@ img24_t *read_BMP(const char *Filename)
 		exit(EXIT_FAILURE);
 	}
 	
-	//Acquire file header and verify if valid
-	fread(&FileHeader, sizeof(file_header_t), 1, Image);
+	//Acquire headers and verify if valid
+	check_result(read_headers(Image, &FileHeader, &BMPHeader, Palette));
+	check_result(parse_headers(&FileHeader, &BMPHeader, Palette, &Dimension));
+	if(!BMP_CAN_CARRY(&Dimension))
+		check_result(BMP_ERROR_FORMAT);
+	
+	check_result(check_file_size(Image, &Dimension));
 	
-	if((FileHeader.CharID_1 != 0x42) || (FileHeader.CharID_2 != 0x4D))
+	//allocate space for pixel matrix in the format of the file (negative height
+	//means top-down row order), every byte of it is read below
+	Img = alloc_img(Dimension.Width, Dimension.Height, Dimension.Stride, &Dimension.Layout);
+	Img->TopDown = Dimension.TopDown;
+	link_rows(Img);
+	
+	//Headers, masks and palette are kept as they are for save_BMP()
+	SizePixelMatrix = (size_t)Img->Stride * Img->Height;
+	Img->HeadersSize = Dimension.OffsetPixelMatrix;
+	Img->Headers = malloc(Img->HeadersSize);
+	if(Img->Headers == NULL)
 	{
-		printf("Error: input file is not a BMP image or have incompatible BMP file identifier. (should be: \"BM\")\n");
+		printf("Error: could not allocate memory for image headers\n\n");
 		exit(EXIT_FAILURE);
 	}
 	
-	//Allocate space for image struct
-	Img = malloc(sizeof(img24_t));
-	
-	//Finding out BMP header version and reading it
-	switch(FileHeader.OffsetPixelMatrix - sizeof(file_header_t))
+	rewind(Image);
+	if(fread(Img->Headers, 1, Img->HeadersSize, Image) != Img->HeadersSize)
 	{
-		case BITMAP_V1_INFOHEADER :
-			fread(&BMPHeaderV1, sizeof(bmp_headerV1_t), 1, Image);
-			Img->Width = BMPHeaderV1.Width;
-			Img->Height = BMPHeaderV1.Height;
-			break;
-			
-		case BITMAP_V2_INFOHEADER :
-			fread(&BMPHeaderV2, sizeof(bmp_headerV2_t), 1, Image);
-			Img->Width = BMPHeaderV2.Width;
-			Img->Height = BMPHeaderV2.Height;
-			break;
-		
-		case BITMAP_V3_INFOHEADER :
-			fread(&BMPHeaderV3, sizeof(bmp_headerV3_t), 1, Image);
-			Img->Width = BMPHeaderV3.Width;
-			Img->Height = BMPHeaderV3.Height;
-			break;
-		
-		case BITMAP_V4_INFOHEADER :
-			fread(&BMPHeaderV4, sizeof(bmp_headerV4_t), 1, Image);
-			Img->Width = BMPHeaderV4.Width;
-			Img->Height = BMPHeaderV4.Height;
-			break;
-			
-		case BITMAP_V5_INFOHEADER :
-			fread(&BMPHeaderV5, sizeof(bmp_headerV5_t), 1, Image);
-			Img->Width = BMPHeaderV5.Width;
-			Img->Height = BMPHeaderV5.Height;
-			break;
-			
-		default :
-			printf("Error: bitmap header is not supported. Suported bitmap headers for reading:\n");
-			printf("       - BITMAPIFOHEADER     (V1)\n");
-			printf("       - BITMAPV2INFOHEADER  (V2)\n");
-			printf("       - BITMAPV3INFOHEADER  (V3)\n");
-			printf("       - BITMAPV4HEADER      (V4)\n");
-			printf("       - BITMAPV5HEADER      (V5)\n");
-			exit(EXIT_FAILURE);
+		printf("Error: image file is truncated (headers shorter than %u bytes)\n\n", Img->HeadersSize);
+		exit(EXIT_FAILURE);
 	}
-		
-	//allocate space for pixel matrix
-	Img->Pixel = malloc(Img->Height * sizeof(pixel24_t*));
 	
-	for(int32_t row = 0; row < Img->Height; row++)
+	//Memory layout matches the file pixel matrix, so it is read in a single call
+	if(fread(Img->Data, 1, SizePixelMatrix, Image) != SizePixelMatrix)
 	{
-		Img->Pixel[row] = malloc(Img->Width * sizeof(pixel24_t));
+		printf("Error: image file is truncated (pixel matrix shorter than %zu bytes)\n\n", SizePixelMatrix);
+		exit(EXIT_FAILURE);
 	}
-
-	//Reading image and copying to pixel matrix
-	for(int32_t row = 0; row < Img->Height; row++)
+	
+	//Padding in the file is not required to be zero, keep it zeroed in memory
+	SizeWidthByte = (size_t)Img->Width * Img->Layout.BytesPerPixel;
+	if(SizeWidthByte != Img->Stride)
 	{
-		for(int32_t column = 0; column < Img->Width; column++)
+		for(int32_t row = 0; row < Img->Height; row++)
 		{
-			fread(&Img->Pixel[row][column], sizeof(pixel24_t), 1, Image);
-			
-			if(column == (Img->Width - 1))
-			{
-				if(((Img->Width * 3) % 4) == 1)
-				{
-					fread(&Trash, sizeof(uint8_t), 3, Image);
-					
-				}else if(((Img->Width * 3) % 4) == 2)
-				{
-					fread(&Trash, sizeof(uint8_t), 2, Image);
-					
-				}else if(((Img->Width * 3) % 4) == 3)
-				{
-					fread(&Trash, sizeof(uint8_t), 1, Image);
-				}
-			}
+			memset((uint8_t *)Img->Pixel[row] + SizeWidthByte, 0, Img->Stride - SizeWidthByte);
 		}
 	}
 	
@@ -231,19 +469,167 @@ img24_t *read_BMP(const char *Filename)
 	return Img;
 }
 
+/******************************************************************************/
+//Build an image view over a whole BMP file held in memory: pixel rows point into
+//File, nothing is copied. Img->Pixel is reallocated to the image height (it can
+//be reused between calls, NULL the first time). Errors are returned, not reported.
+int view_BMP(uint8_t *File, size_t FileSize, img24_t *Img)
+{
+	dimensions_t	Dimension;
+	bmp_headerV3_t	BMPHeader;
+	uint8_t			Palette[BMP_PALETTE_SIZE];
+	pixel24_t		**Pixel;
+	size_t			SizePixelMatrix;
+	int				Result;
+	
+	//All supported header versions start with the V1 fields, color masks may
+	//follow them
+	if(FileSize < sizeof(file_header_t) + sizeof(bmp_headerV1_t))
+		return BMP_ERROR_READ;
+	
+	memset(&BMPHeader, 0, sizeof(bmp_headerV3_t));
+	memcpy(&BMPHeader, File + sizeof(file_header_t),
+		   (FileSize - sizeof(file_header_t) < sizeof(bmp_headerV3_t)) ? FileSize - sizeof(file_header_t) : sizeof(bmp_headerV3_t));
+	
+	//Palette of 8 bpp images right after the BMP header
+	memset(Palette, 0, BMP_PALETTE_SIZE);
+	if(sizeof(file_header_t) + (uint64_t)BMPHeader.SizeHeader < FileSize)
+		memcpy(Palette, File + sizeof(file_header_t) + BMPHeader.SizeHeader,
+			   (FileSize - sizeof(file_header_t) - BMPHeader.SizeHeader < BMP_PALETTE_SIZE) ?
+			   FileSize - sizeof(file_header_t) - BMPHeader.SizeHeader : BMP_PALETTE_SIZE);
+	
+	Result = parse_headers((const file_header_t *)File, &BMPHeader, Palette, &Dimension);
+	if(Result != BMP_OK)
+		return Result;
+	
+	if(!BMP_CAN_CARRY(&Dimension))
+		return BMP_ERROR_FORMAT;
+	
+	SizePixelMatrix = (size_t)Dimension.Stride * Dimension.Height;
+	if(Dimension.OffsetPixelMatrix + SizePixelMatrix > FileSize)
+		return BMP_ERROR_TRUNCATED;
+	
+	Pixel = realloc(Img->Pixel, Dimension.Height * sizeof(pixel24_t *));
+	if(Pixel == NULL)
+		return BMP_ERROR_MEMORY;
+	
+	Img->Pixel = Pixel;
+	Img->Width = Dimension.Width;
+	Img->Height = Dimension.Height;
+	Img->Stride = Dimension.Stride;
+	Img->TopDown = Dimension.TopDown;
+	Img->Layout = Dimension.Layout;
+	Img->Headers = NULL;
+	Img->HeadersSize = 0;
+	Img->Map = NULL;
+	Img->MapSize = 0;
+	Img->Data = File + Dimension.OffsetPixelMatrix;
+	link_rows(Img);
+	
+	return BMP_OK;
+}
+
+/******************************************************************************/
+//Map BMP image file to memory. Pixel rows point directly into the mapping, no
+//pixel data is copied. With Writable set the mapping is shared, so changes to
+//the pixels are written to the file.
+img24_t *map_BMP(const char *Filename, uint8_t Writable)
+{
+	img24_t		*Img;
+	
+	check_result(try_map_BMP(Filename, Writable, &Img));
+	
+	return Img;
+}
+
+/******************************************************************************/
+//Map BMP image file to memory without exiting on errors (for working on many
+//files). Returns BMP_OK or an error code.
+int try_map_BMP(const char *Filename, uint8_t Writable, img24_t **Image)
+{
+	img24_t			*Img;
+	uint8_t			*Map;
+	struct stat		FileStat;
+	int				FileDescriptor;
+	int				Result;
+	
+	*Image = NULL;
+	
+	//open and map image
+	FileDescriptor = open(Filename, Writable ? O_RDWR : O_RDONLY);
+	if(FileDescriptor < 0)
+		return BMP_ERROR_READ;
+	
+	if((fstat(FileDescriptor, &FileStat) < 0) ||
+	   ((size_t)FileStat.st_size < sizeof(file_header_t) + BITMAP_V1_INFOHEADER))
+	{
+		close(FileDescriptor);
+		return BMP_ERROR_READ;
+	}
+	
+	Map = mmap(NULL, FileStat.st_size, Writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+			   MAP_SHARED, FileDescriptor, 0);
+	
+	//The mapping stays valid after the file descriptor is closed
+	close(FileDescriptor);
+	
+	if(Map == MAP_FAILED)
+		return BMP_ERROR_READ;
+	
+	//Validate headers and build the view
+	Img = malloc(sizeof(img24_t));
+	if(Img == NULL)
+	{
+		munmap(Map, FileStat.st_size);
+		return BMP_ERROR_MEMORY;
+	}
+	
+	Img->Pixel = NULL;
+	Result = view_BMP(Map, FileStat.st_size, Img);
+	if(Result != BMP_OK)
+	{
+		munmap(Map, FileStat.st_size);
+		free(Img->Pixel);
+		free(Img);
+		return Result;
+	}
+	
+	Img->Map = Map;
+	Img->MapSize = FileStat.st_size;
+	
+	*Image = Img;
+	return BMP_OK;
+}
+
+/******************************************************************************/
+//Read dimensions from the headers of an open BMP image, without reporting
+//errors (for scanning many files). Returns BMP_OK or an error code.
+int read_dimensions_BMP(FILE *Image, dimensions_t *Dimension)
+{
+	file_header_t	FileHeader;
+	bmp_headerV3_t	BMPHeader;
+	uint8_t			Palette[BMP_PALETTE_SIZE];
+	int				Result;
+	
+	if(read_headers(Image, &FileHeader, &BMPHeader, Palette) != BMP_OK)
+		return BMP_ERROR_READ;
+	
+	Result = parse_headers(&FileHeader, &BMPHeader, Palette, Dimension);
+	if(Result != BMP_OK)
+		return Result;
+	
+	return check_file_size(Image, Dimension);
+}
+
 /******************************************************************************/
 //Find dimensions of the BMP image [OK]
-#if 0
 dimensions_t dimensions_BMP(const char *Filename)
 {
 	file_header_t	FileHeader;
-	bmp_headerV1_t	BMPHeaderV1;
-	bmp_headerV2_t	BMPHeaderV2;
-	bmp_headerV3_t	BMPHeaderV3;
-	bmp_headerV4_t	BMPHeaderV4;
-	bmp_headerV5_t	BMPHeaderV5;
-	dimensions_t Dimension;
-	FILE *Image;
+	bmp_headerV3_t	BMPHeader;
+	uint8_t			Palette[BMP_PALETTE_SIZE];
+	dimensions_t	Dimension;
+	FILE			*Image;
 	
 	//Open image
 	Image = fopen(Filename, "rb");
@@ -253,64 +639,22 @@ dimensions_t dimensions_BMP(const char *Filename)
 		exit(EXIT_FAILURE);
 	}
 	
-	//Acquire file header and verify if valid
-	fread(&FileHeader, sizeof(file_header_t), 1, Image);
-	
-	if((FileHeader.CharID_1 != 0x42) || (FileHeader.CharID_2 != 0x4D))
+	//Only the file header, the V1 part of the BMP header and the color masks
+	//are read, all supported header versions start with the same fields
+	if(read_headers(Image, &FileHeader, &BMPHeader, Palette) != BMP_OK)
 	{
-		printf("Error: input file is not a BMP image or have incompatible BMP file identifier. (should be: \"BM\")\n");
+		printf("Error: input file is too small to be a BMP image\n\n");
 		exit(EXIT_FAILURE);
 	}
 	
-	//Finding out BMP header version and reading it
-	switch(FileHeader.OffsetPixelMatrix - sizeof(file_header_t))
-	{
-		case BITMAP_V1_INFOHEADER :
-			fread(&BMPHeaderV1, sizeof(bmp_headerV1_t), 1, Image);
-			Dimension.Width = BMPHeaderV1.Width;
-			Dimension.Height = BMPHeaderV1.Height;
-			break;
-			
-		case BITMAP_V2_INFOHEADER :
-			fread(&BMPHeaderV2, sizeof(bmp_headerV2_t), 1, Image);
-			Dimension.Width = BMPHeaderV2.Width;
-			Dimension.Height = BMPHeaderV2.Height;
-			break;
-		
-		case BITMAP_V3_INFOHEADER :
-			fread(&BMPHeaderV3, sizeof(bmp_headerV3_t), 1, Image);
-			Dimension.Width = BMPHeaderV3.Width;
-			Dimension.Height = BMPHeaderV3.Height;
-			break;
-		
-		case BITMAP_V4_INFOHEADER :
-			fread(&BMPHeaderV4, sizeof(bmp_headerV4_t), 1, Image);
-			Dimension.Width = BMPHeaderV4.Width;
-			Dimension.Height = BMPHeaderV4.Height;
-			break;
-			
-		case BITMAP_V5_INFOHEADER :
-			fread(&BMPHeaderV5, sizeof(bmp_headerV5_t), 1, Image);
-			Dimension.Width = BMPHeaderV5.Width;
-			Dimension.Height = BMPHeaderV5.Height;
-			break;
-			
-		default :
-			printf("Error: bitmap header is not supported. Suported bitmap headers for reading:\n");
-			printf("       - BITMAPIFOHEADER     (V1)\n");
-			printf("       - BITMAPV2INFOHEADER  (V2)\n");
-			printf("       - BITMAPV3INFOHEADER  (V3)\n");
-			printf("       - BITMAPV4HEADER      (V4)\n");
-			printf("       - BITMAPV5HEADER      (V5)\n");
-			exit(EXIT_FAILURE);
-	}
-
+	check_result(parse_headers(&FileHeader, &BMPHeader, Palette, &Dimension));
+	check_result(check_file_size(Image, &Dimension));
+	
 	fclose(Image);
-
+	
 	return Dimension;
-
+	
 }
-#endif
 /******************************************************************************/
 //Display header information [OK]
 void display_header(const char *Filename)
@@ -321,6 +665,7 @@ void display_header(const char *Filename)
 	bmp_headerV3_t BMPHeaderV3;
 	bmp_headerV4_t BMPHeaderV4;
 	bmp_headerV5_t BMPHeaderV5;
+	uint32_t SizeHeader = 0;
 	
 	FILE *File;
 	
@@ -341,8 +686,12 @@ void display_header(const char *Filename)
 	printf("Reserved_2: %u\n", FileHeader.Reserved_2);
 	printf("Offset until pixel matrix: %u\n\n", FileHeader.OffsetPixelMatrix);
 	
+	//Header version from its size, a palette or color masks may follow it
+	fread(&SizeHeader, sizeof(uint32_t), 1, File);
+	fseek(File, sizeof(file_header_t), SEEK_SET);
+	
 	//Print Windows BMP header information
-	switch(FileHeader.OffsetPixelMatrix - sizeof(file_header_t))
+	switch(SizeHeader)
 	{
 		//----------------------------------------------------------------------
 		case BITMAP_V1_INFOHEADER :
@@ -409,7 +758,7 @@ void display_header(const char *Filename)
 			}
 			
 			break;
-
+		
 		//----------------------------------------------------------------------
 		case BITMAP_V2_INFOHEADER :
 			
@@ -549,12 +898,12 @@ void display_header(const char *Filename)
 			printf("Blue mask ..................... %u\n", BMPHeaderV3.BlueMask);
 			
 			printf("Alpha mask .................... %u\n\n", BMPHeaderV3.AlphaMask);
-
+			
 			break;
 	
 		//----------------------------------------------------------------------
 		case BITMAP_V4_INFOHEADER :
-
+			
 			fread(&BMPHeaderV4, sizeof(bmp_headerV4_t), 1, File);
 			printf("BMP header type: BITMAPV4HEADER (V4)\n");
 			printf("BMP header size ............... %u bytes\n", BMPHeaderV4.SizeHeader);
@@ -621,7 +970,7 @@ void display_header(const char *Filename)
 			printf("Blue mask ..................... %u\n", BMPHeaderV4.BlueMask);
 			
 			printf("Alpha mask .................... %u\n", BMPHeaderV4.AlphaMask);
-
+			
 			printf("Color space ................... ");
 			switch(BMPHeaderV4.CSType)
 			{
@@ -652,12 +1001,12 @@ void display_header(const char *Filename)
 			printf("Toned response for red ........ %X\n", BMPHeaderV4.GammaRed);
 			printf("Toned response for green ...... %X\n", BMPHeaderV4.GammaGreen);
 			printf("Toned response for blue ....... %X\n\n", BMPHeaderV4.GammaBlue);
-
+			
 			break;
-
+		
 		//----------------------------------------------------------------------
 		case BITMAP_V5_INFOHEADER :
-
+			
 			fread(&BMPHeaderV5, sizeof(bmp_headerV4_t), 1, File);
 			printf("BMP header type: BITMAPV5HEADER (V5)\n");
 			printf("BMP header size ............... %u bytes\n", BMPHeaderV5.SizeHeader);
@@ -724,7 +1073,7 @@ void display_header(const char *Filename)
 			printf("Blue mask ..................... %u\n", BMPHeaderV5.BlueMask);
 			
 			printf("Alpha mask .................... %u\n", BMPHeaderV5.AlphaMask);
-
+			
 			printf("Color space ................... ");
 			switch(BMPHeaderV5.CSType)
 			{
@@ -755,7 +1104,7 @@ void display_header(const char *Filename)
 			printf("Toned response for red ........ %X\n", BMPHeaderV5.GammaRed);
 			printf("Toned response for green ...... %X\n", BMPHeaderV5.GammaGreen);
 			printf("Toned response for blue ....... %X\n", BMPHeaderV5.GammaBlue);
-
+			
 			printf("Rendering intent .............. ");
 			switch(BMPHeaderV5.Intent)
 			{
@@ -781,49 +1130,79 @@ void display_header(const char *Filename)
 			printf("Profile data .................. %u\n", BMPHeaderV5.ProfileData);
 			printf("Profile size .................. %u\n", BMPHeaderV5.ProfileSize);
 			printf("Reserved ...................... %u\n\n", BMPHeaderV5.Reserved);
-
+			
 			break;
-
+		
 		//----------------------------------------------------------------------
 		default :
 		
 		printf("Error: wrong size of BMP header");
 		exit(EXIT_FAILURE);
-
+		
 	}
-
+	
 	fclose(File);
+	
+}
 
+/******************************************************************************/
+//Message describing a BMP_* result
+const char *bmp_error(int Result)
+{
+	switch(Result)
+	{
+		case BMP_OK :
+			return "valid image";
+		case BMP_ERROR_READ :
+			return "file could not be read or is too small to be a BMP image";
+		case BMP_ERROR_ID :
+			return "file is not a BMP image (identifier should be \"BM\")";
+		case BMP_ERROR_HEADER :
+			return "bitmap header is not supported (V1 to V5 headers are)";
+		case BMP_ERROR_DIMENSIONS :
+			return "invalid or too large image dimensions";
+		case BMP_ERROR_FORMAT :
+			return "only 24 bpp, 32 bpp (BGRX or 8 bit color masks) and 8 bpp palette (2 colors or more) images are supported";
+		case BMP_ERROR_TRUNCATED :
+			return "image file is truncated (pixel matrix is incomplete)";
+		case BMP_ERROR_MEMORY :
+			return "could not allocate memory for image";
+		default :
+			return "unknown error";
+	}
 }
 
 /******************************************************************************/
-//Frees space occupied by Image
-void free_img(img24_t *Img)
+//Allocate an image with contiguous pixel matrix (padded rows, zero filled)
+img24_t *create_img(int32_t Width, int32_t Height)
 {
-	for (int32_t row = 0; row < Img->Height; row++)
+	const pixel_layout_t	Layout = {3, 3, {0, 1, 2}};
+	img24_t					*Img;
+	
+	if((Width < 1) || (Height < 1) || (Width > BMP_MAX_WIDTH))
 	{
-		free(Img->Pixel[row]);
+		printf("Error: invalid image dimensions (%d by %d)\n\n", Width, Height);
+		exit(EXIT_FAILURE);
 	}
+	
+	Img = alloc_img(Width, Height, ROW_SIZE_24BPP(Width), &Layout);
+	memset(Img->Data, 0, (size_t)Img->Stride * Height);
+	
+	link_rows(Img);
+	
+	return Img;
+}
+
+/******************************************************************************/
+//Frees space occupied by Image
+void free_img(img24_t *Img)
+{
+	if(Img->Map != NULL)
+		munmap(Img->Map, Img->MapSize);
+	else
+		free(Img->Data);
+	
+	free(Img->Headers);
 	free(Img->Pixel);
 	free(Img);
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -9,6 +9,8 @@
 #define __BITMAP_H__
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 
 /*******************************************************************************
  *                            MACROS AND TYPEDEF                               *
@@ -27,6 +29,40 @@
 #define RESOLUTION_X	2834
 #define RESOLUTION_Y	2834
 
+//Size in bytes of one 24 bpp row including padding to a multiple of 4 bytes
+#define ROW_SIZE_24BPP(Width)	((((uint32_t)(Width) * 3) + 3) & ~((uint32_t)3))
+
+//Size in bytes of one row of any color depth including padding
+#define ROW_SIZE_BPP(Width, ColorDepth)	((uint32_t)(((uint64_t)(Width) * (ColorDepth) + 31) / 32 * 4))
+
+//Size in bytes of the largest palette (256 colors of 4 bytes: B, G, R, unused)
+#define BMP_PALETTE_SIZE		1024
+
+//Widest image handled. It keeps every row size above well inside 32 bits, and
+//streaming holds at least one whole row in memory
+#define BMP_MAX_WIDTH			(1 << 24)
+
+//Compression methods of the pixel matrix handled
+#define BMP_RGB					0		//BI_RGB, no compression
+#define BMP_BITFIELDS			3		//BI_BITFIELDS, channels given by color masks
+#define BMP_ALPHABITFIELDS		6		//BI_ALPHABITFIELDS, same with an alpha mask
+
+//Non zero if a payload can be stored in the pixels of an image (see pixel_layout)
+#define BMP_CAN_CARRY(Img)		((Img)->Layout.SlotsPerPixel != 0)
+
+//Alignment in bytes of the pixel matrix allocation (one cache line)
+#define IMG_ALIGNMENT	64
+
+//Results of functions that report errors instead of ending the program
+#define BMP_OK					0
+#define BMP_ERROR_READ			-1		//File could not be read or is too small
+#define BMP_ERROR_ID			-2		//Not a BMP file ("BM" identifier missing)
+#define BMP_ERROR_HEADER		-3		//Unsupported BMP header version
+#define BMP_ERROR_DIMENSIONS	-4		//Invalid or too large width or height
+#define BMP_ERROR_FORMAT		-5		//Pixel format can not carry a payload
+#define BMP_ERROR_TRUNCATED		-6		//Pixel matrix goes past the end of the file
+#define BMP_ERROR_MEMORY		-7		//Memory allocation failed
+
 /*******************************************************************************
  *                                   STRUCTURES                                *
  *******************************************************************************/
@@ -194,11 +230,50 @@ struct bmp_headerV5
 };
 #pragma pack(pop)
 
+//Where the channels are in the pixels. 24 and 32 bpp pixels have one slot per
+//color channel (blue, green, red), alpha or unused bytes are left alone. 8 bpp
+//pixels have one slot, the palette index. The palette is not sorted, so an
+//index whose lowest bit has to change is replaced by Nearest[index]: the index
+//of the closest color (in RGB) among the indexes with the other lowest bit.
+struct pixel_layout
+{
+	uint8_t BytesPerPixel;				//1, 3 or 4
+	uint8_t SlotsPerPixel;				//3, or 1 for palette indexes (0 if the format is not handled)
+	uint8_t Offset[3];					//Byte of the blue, green and red channels in a 32 bpp pixel
+	uint8_t Nearest[256];				//8 bpp only, see above
+};
+
+//Image in memory. The pixel matrix is one block laid out exactly like the BMP
+//pixel matrix (rows padded to 4 bytes), in the pixel format of the file.
+//Pixel[row] points to the start of each row inside Data, row 0 being the bottom
+//row of the image (rows of other formats than 24 bpp are only addressed as bytes).
+//Images from map_BMP() are views: Data points into the file mapping.
 struct img24
 {
 	struct pixel_24bpp **Pixel;
+	uint8_t *Data;						//Pixel matrix (Stride * Height bytes)
+	uint32_t Stride;					//Size of one row in bytes including padding
 	int32_t Width;
-	int32_t Height;
+	int32_t Height;						//Always positive, see TopDown
+	uint8_t TopDown;					//Rows are stored top ==> bottom in Data
+	struct pixel_layout Layout;
+	uint8_t *Headers;					//Headers, masks and palette read by read_BMP() (NULL if none)
+	uint32_t HeadersSize;
+	void *Map;							//File mapping (NULL if Data was allocated)
+	size_t MapSize;
+};
+
+//Image layout information taken from the headers only
+struct dimensions
+{
+	int32_t Width;
+	int32_t Height;						//Always positive, see TopDown
+	uint8_t TopDown;					//Rows are stored top ==> bottom in the file
+	uint16_t ColorDepth;				//Bits per pixel
+	uint32_t Compression;				//Compression method (0 ==> BI_RGB)
+	uint32_t OffsetPixelMatrix;			//Bytes from the start of the file to the pixel matrix
+	uint32_t Stride;					//Size of one row in bytes including padding
+	struct pixel_layout Layout;
 };
 
 //bmp_headerV1_t ==> BITMAPINFOHEADER	(40 bytes)
@@ -218,7 +293,9 @@ typedef struct bmp_headerV5			bmp_headerV5_t;
 
 typedef struct file_header			file_header_t; //(14 bytes)
 typedef struct pixel_24bpp			pixel24_t;
+typedef struct pixel_layout			pixel_layout_t;
 typedef struct img24				img24_t;
+typedef struct dimensions			dimensions_t;
 
 
 /*******************************************************************************
@@ -228,19 +305,38 @@ typedef struct img24				img24_t;
 //========================= IMAGE FILE MANIPULATION ============================
 
 //------------------------------------------------------------------------------
-//create image file
+//create image file, with the headers it was read with if any (24 bpp V1 header
+//otherwise)
 void save_BMP(img24_t *Img, const char *Filename);
 //------------------------------------------------------------------------------
-//Read BMP image to a pixel matrix
+//Read BMP image to a pixel matrix, kept in the pixel format of the file
 img24_t *read_BMP(const char *Filename);
 //------------------------------------------------------------------------------
-//Find Width of the BMP image
-//dimensions_t dimensions_BMP(const char *Filename);
+//Build an image view over a BMP file held in memory, returns BMP_OK or an error
+int view_BMP(uint8_t *File, size_t FileSize, img24_t *Img);
+//------------------------------------------------------------------------------
+//Map BMP image file to memory without copying pixels (free with free_img)
+img24_t *map_BMP(const char *Filename, uint8_t Writable);
+//------------------------------------------------------------------------------
+//Same as map_BMP() without exiting on errors, returns BMP_OK or an error code
+int try_map_BMP(const char *Filename, uint8_t Writable, img24_t **Image);
+//------------------------------------------------------------------------------
+//Find dimensions and layout of the BMP image reading the headers only
+dimensions_t dimensions_BMP(const char *Filename);
+//------------------------------------------------------------------------------
+//Same as dimensions_BMP() for an open file, returns BMP_OK or an error code
+int read_dimensions_BMP(FILE *Image, dimensions_t *Dimension);
 //------------------------------------------------------------------------------
 //Display header information
 void display_header(const char *Filename);
 //------------------------------------------------------------------------------
-//Frees space occupied by PixelMatrix
+//Allocate a zero filled image of the given dimensions
+img24_t *create_img(int32_t Width, int32_t Height);
+//------------------------------------------------------------------------------
+//Message describing a BMP_* result
+const char *bmp_error(int Result);
+//------------------------------------------------------------------------------
+//Frees space occupied by PixelMatrix (or unmaps a mapped image)
 void free_img(img24_t *Img);
 
 
@@ -0,0 +1,377 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the LZ payload compression, made of independent blocks so it	*
+ * can be decompressed as a stream												*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "compress.h"
+
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+#define MIN_MATCH		4
+#define MAX_OFFSET		65535
+#define LAST_LITERALS	5				//Block always ends with a few literals
+#define HASH_BITS		14
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Hash of the 4 bytes at Data
+static uint32_t hash4(const uint8_t *Data)
+{
+	uint32_t Value;
+	
+	memcpy(&Value, Data, sizeof(Value));
+	return (Value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/******************************************************************************/
+//Write a count in extra length bytes (255 each until one is below 255)
+static size_t write_length(uint8_t *Output, size_t Length)
+{
+	size_t Size = 0;
+	
+	for(; Length >= 255; Length -= 255)
+		Output[Size++] = 255;
+	Output[Size++] = Length;
+	
+	return Size;
+}
+
+/******************************************************************************/
+//Write one sequence. Returns the new output position, or 0 if it does not fit
+//under Limit.
+static size_t write_sequence(uint8_t *Output, size_t Op, size_t Limit, const uint8_t *Literal,
+							 size_t NumLiterals, size_t Offset, size_t MatchLength)
+{
+	size_t	MatchCode = (MatchLength > 0) ? (MatchLength - MIN_MATCH) : 0;
+	
+	if(Op + 1 + NumLiterals / 255 + 1 + NumLiterals + 2 + MatchCode / 255 + 1 > Limit)
+		return 0;
+	
+	Output[Op++] = (((NumLiterals < 15) ? NumLiterals : 15) << 4) | ((MatchCode < 15) ? MatchCode : 15);
+	if(NumLiterals >= 15)
+		Op += write_length(Output + Op, NumLiterals - 15);
+	
+	memcpy(Output + Op, Literal, NumLiterals);
+	Op += NumLiterals;
+	
+	if(MatchLength > 0)
+	{
+		Output[Op++] = Offset & 0xFF;
+		Output[Op++] = Offset >> 8;
+		if(MatchCode >= 15)
+			Op += write_length(Output + Op, MatchCode - 15);
+	}
+	
+	return Op;
+}
+
+/******************************************************************************/
+//Greedy LZ coding of one block with a single entry hash table. Returns the
+//coded size, or 0 if it would not be smaller than Limit.
+static size_t encode_block(const uint8_t *Input, size_t Size, uint8_t *Output, size_t Limit)
+{
+	uint32_t	Table[1 << HASH_BITS];
+	size_t		Ip = 0;
+	size_t		Anchor = 0;
+	size_t		Op = 0;
+	size_t		Candidate;
+	size_t		Length;
+	uint32_t	Hash;
+	
+	memset(Table, 0, sizeof(Table));
+	
+	while(Ip + MIN_MATCH + LAST_LITERALS <= Size)
+	{
+		Hash = hash4(Input + Ip);
+		Candidate = Table[Hash];
+		Table[Hash] = Ip;
+		
+		if((Candidate >= Ip) || (Ip - Candidate > MAX_OFFSET) || (memcmp(Input + Candidate, Input + Ip, MIN_MATCH) != 0))
+		{
+			Ip++;
+			continue;
+		}
+		
+		Length = MIN_MATCH;
+		while((Ip + Length < Size - LAST_LITERALS) && (Input[Candidate + Length] == Input[Ip + Length]))
+			Length++;
+		
+		Op = write_sequence(Output, Op, Limit, Input + Anchor, Ip - Anchor, Ip - Candidate, Length);
+		if(Op == 0)
+			return 0;
+		
+		Ip += Length;
+		Anchor = Ip;
+	}
+	
+	//Last sequence has literals only
+	return write_sequence(Output, Op, Limit, Input + Anchor, Size - Anchor, 0, 0);
+}
+
+/******************************************************************************/
+//Decode one LZ block. Returns the decoded size, or -1 if the block is corrupt.
+static int64_t decode_block(const uint8_t *Input, size_t Size, uint8_t *Output, size_t OutputSize)
+{
+	size_t		Ip = 0;
+	size_t		Op = 0;
+	size_t		NumLiterals;
+	size_t		Offset;
+	size_t		Length;
+	uint8_t		Token;
+	uint8_t		Extra;
+	
+	while(1)
+	{
+		if(Ip >= Size)
+			return -1;
+		Token = Input[Ip++];
+		
+		NumLiterals = Token >> 4;
+		if(NumLiterals == 15)
+		{
+			do
+			{
+				if(Ip >= Size)
+					return -1;
+				Extra = Input[Ip++];
+				NumLiterals += Extra;
+			} while(Extra == 255);
+		}
+		
+		if((NumLiterals > Size - Ip) || (NumLiterals > OutputSize - Op))
+			return -1;
+		memcpy(Output + Op, Input + Ip, NumLiterals);
+		Ip += NumLiterals;
+		Op += NumLiterals;
+		
+		//Block ends after the literals of its last sequence
+		if(Ip == Size)
+			return Op;
+		
+		if(Size - Ip < 2)
+			return -1;
+		Offset = Input[Ip] | (Input[Ip + 1] << 8);
+		Ip += 2;
+		if((Offset == 0) || (Offset > Op))
+			return -1;
+		
+		Length = (Token & 15) + MIN_MATCH;
+		if((Token & 15) == 15)
+		{
+			do
+			{
+				if(Ip >= Size)
+					return -1;
+				Extra = Input[Ip++];
+				Length += Extra;
+			} while(Extra == 255);
+		}
+		
+		if(Length > OutputSize - Op)
+			return -1;
+		
+		//Byte by byte, the match may overlap the bytes it produces
+		for(size_t i = 0; i < Length; i++)
+			Output[Op + i] = Output[Op - Offset + i];
+		Op += Length;
+	}
+}
+
+/******************************************************************************/
+//Compress one block with its block header. Returns the bytes written.
+static size_t compress_block(const uint8_t *Input, size_t Size, uint8_t *Output)
+{
+	size_t		DataSize;
+	uint32_t	Header;
+	
+	DataSize = encode_block(Input, Size, Output + COMPRESS_BLOCK_HEADER, Size - 1);
+	if(DataSize == 0)
+	{
+		memcpy(Output + COMPRESS_BLOCK_HEADER, Input, Size);
+		DataSize = Size;
+		Header = DataSize | COMPRESS_RAW_BLOCK;
+	}
+	else
+	{
+		Header = DataSize;
+	}
+	
+	for(int i = 0; i < COMPRESS_BLOCK_HEADER; i++)
+		Output[i] = Header >> (8 * i);
+	
+	return COMPRESS_BLOCK_HEADER + DataSize;
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Compress a buffer, block by block
+uint64_t compress_buffer(const uint8_t *Input, uint64_t Size, uint8_t *Output)
+{
+	uint64_t	Done = 0;
+	uint64_t	OutputSize = 0;
+	size_t		Count;
+	
+	while(Done < Size)
+	{
+		Count = (Size - Done < COMPRESS_BLOCK_SIZE) ? (Size - Done) : COMPRESS_BLOCK_SIZE;
+		OutputSize += compress_block(Input + Done, Count, Output + OutputSize);
+		Done += Count;
+	}
+	
+	return OutputSize;
+}
+
+/******************************************************************************/
+//Compress a file into another one, block by block
+int64_t compress_file(FILE *Input, FILE *Output, uint64_t *InputSize)
+{
+	uint8_t		*Block = malloc(COMPRESS_BLOCK_SIZE);
+	uint8_t		*Packed = malloc(COMPRESS_BLOCK_HEADER + COMPRESS_BLOCK_SIZE);
+	int64_t		OutputSize = 0;
+	size_t		Count;
+	size_t		PackedSize;
+	
+	*InputSize = 0;
+	
+	if((Block == NULL) || (Packed == NULL))
+		OutputSize = -1;
+	
+	while((OutputSize >= 0) && ((Count = fread(Block, 1, COMPRESS_BLOCK_SIZE, Input)) > 0))
+	{
+		PackedSize = compress_block(Block, Count, Packed);
+		if(fwrite(Packed, 1, PackedSize, Output) != PackedSize)
+			OutputSize = -1;
+		else
+			OutputSize += PackedSize;
+		
+		*InputSize += Count;
+	}
+	
+	if(ferror(Input))
+		OutputSize = -1;
+	
+	free(Block);
+	free(Packed);
+	
+	return OutputSize;
+}
+
+/******************************************************************************/
+//Prepare a streaming decompressor
+int decompress_init(decompress_stream_t *Stream)
+{
+	Stream->Block = malloc(COMPRESS_BLOCK_HEADER + COMPRESS_BLOCK_SIZE);
+	Stream->Output = malloc(COMPRESS_BLOCK_SIZE);
+	Stream->Fill = 0;
+	Stream->Need = COMPRESS_BLOCK_HEADER;
+	Stream->Total = 0;
+	Stream->First = 0;
+	Stream->Last = UINT64_MAX;
+	
+	if((Stream->Block == NULL) || (Stream->Output == NULL))
+	{
+		free(Stream->Block);
+		free(Stream->Output);
+		return -1;
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Feed compressed bytes, complete blocks are decoded and written
+int decompress_feed(decompress_stream_t *Stream, const uint8_t *Data, size_t Size, FILE *Output)
+{
+	uint32_t	Header;
+	size_t		Count;
+	int64_t		Decoded;
+	uint64_t	Start;
+	uint64_t	End;
+	uint8_t		*Block;
+	
+	while(Size > 0)
+	{
+		Count = Stream->Need - Stream->Fill;
+		if(Count > Size)
+			Count = Size;
+		
+		memcpy(Stream->Block + Stream->Fill, Data, Count);
+		Stream->Fill += Count;
+		Data += Count;
+		Size -= Count;
+		
+		if(Stream->Fill < Stream->Need)
+			break;
+		
+		Header = 0;
+		for(int i = 0; i < COMPRESS_BLOCK_HEADER; i++)
+			Header |= (uint32_t)Stream->Block[i] << (8 * i);
+		
+		//Block header complete, now gather the block data
+		if(Stream->Need == COMPRESS_BLOCK_HEADER)
+		{
+			if(((Header & ~COMPRESS_RAW_BLOCK) == 0) || ((Header & ~COMPRESS_RAW_BLOCK) > COMPRESS_BLOCK_SIZE))
+				return -1;
+			
+			Stream->Need += Header & ~COMPRESS_RAW_BLOCK;
+			continue;
+		}
+		
+		if(Header & COMPRESS_RAW_BLOCK)
+		{
+			Block = Stream->Block + COMPRESS_BLOCK_HEADER;
+			Decoded = Stream->Need - COMPRESS_BLOCK_HEADER;
+		}
+		else
+		{
+			Block = Stream->Output;
+			Decoded = decode_block(Stream->Block + COMPRESS_BLOCK_HEADER, Stream->Need - COMPRESS_BLOCK_HEADER,
+								   Stream->Output, COMPRESS_BLOCK_SIZE);
+			if(Decoded < 0)
+				return -1;
+		}
+		
+		//Part of the block inside the output window
+		Start = (Stream->First > Stream->Total) ? Stream->First - Stream->Total : 0;
+		End = (Stream->Last - Stream->Total < (uint64_t)Decoded) ? Stream->Last - Stream->Total : (uint64_t)Decoded;
+		if((Stream->Last > Stream->Total) && (Start < End) && (fwrite(Block + Start, 1, End - Start, Output) != End - Start))
+			return -1;
+		
+		Stream->Total += Decoded;
+		Stream->Fill = 0;
+		Stream->Need = COMPRESS_BLOCK_HEADER;
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Release the decompressor
+int decompress_end(decompress_stream_t *Stream)
+{
+	int Result = (Stream->Fill == 0) ? 0 : -1;
+	
+	free(Stream->Block);
+	free(Stream->Output);
+	Stream->Block = NULL;
+	Stream->Output = NULL;
+	
+	return Result;
+}
@@ -0,0 +1,80 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the LZ payload compression, made of independent    *
+ * blocks so it can be decompressed as a stream                      *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Compressed data is a sequence of blocks, each coding at most
+//COMPRESS_BLOCK_SIZE input bytes:
+//  uint32 (little endian): size of the block data, bit 31 set if stored raw
+//  block data: LZ sequences, or the input bytes as is
+//A sequence is a token (literal count << 4 | match length - 4), extra literal
+//count bytes when the count is 15, the literals, and unless the block ends
+//there a 16 bit match offset and extra match length bytes when it is 15+4.
+//Extra bytes add 255 each until one is below 255.
+
+#define COMPRESS_BLOCK_SIZE		(1 << 16)
+#define COMPRESS_BLOCK_HEADER	4
+#define COMPRESS_RAW_BLOCK		0x80000000u
+
+//Largest compressed size of Size input bytes (incompressible blocks are raw)
+#define COMPRESS_BOUND(Size)	((Size) + ((Size) / COMPRESS_BLOCK_SIZE + 1) * COMPRESS_BLOCK_HEADER)
+
+/*******************************************************************************
+ *                                   STRUCTURES                                *
+ *******************************************************************************/
+
+//Streaming decompressor: compressed bytes are fed in any amount, every block
+//is decoded as soon as it is complete
+struct decompress_stream
+{
+	uint8_t *Block;						//Compressed block being gathered
+	size_t Fill;						//Bytes of Block gathered so far
+	size_t Need;						//Size of the current block (header included)
+	uint8_t *Output;					//Decoded block
+	uint64_t Total;						//Bytes decoded so far
+	uint64_t First;						//Only decoded bytes [First, Last) are written,
+	uint64_t Last;						//all of them unless set after decompress_init()
+};
+
+typedef struct decompress_stream	decompress_stream_t;
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Compress Size bytes of Input into Output (COMPRESS_BOUND(Size) bytes long).
+//Returns the compressed size.
+uint64_t compress_buffer(const uint8_t *Input, uint64_t Size, uint8_t *Output);
+//------------------------------------------------------------------------------
+//Compress a whole file into another one, one block at a time. Returns the
+//compressed size, or -1 on read/write error. InputSize gets the input size.
+int64_t compress_file(FILE *Input, FILE *Output, uint64_t *InputSize);
+
+//------------------------------------------------------------------------------
+//Prepare a streaming decompressor. Returns -1 if out of memory.
+int decompress_init(decompress_stream_t *Stream);
+//------------------------------------------------------------------------------
+//Feed Size compressed bytes, decoded blocks are written to Output. Returns -1
+//if the data is corrupt or Output can not be written.
+int decompress_feed(decompress_stream_t *Stream, const uint8_t *Data, size_t Size, FILE *Output);
+//------------------------------------------------------------------------------
+//Release the decompressor. Returns -1 if a block was left incomplete.
+int decompress_end(decompress_stream_t *Stream);
+
+
+#endif
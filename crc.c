@@ -0,0 +1,160 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the CRC32C (Castagnoli) checksum								*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "crc.h"
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Slicing-by-8 tables: Table[k][b] is the CRC of byte b followed by k zeros
+static uint32_t Table[8][256];
+static pthread_once_t TableOnce = PTHREAD_ONCE_INIT;
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Build the slicing-by-8 tables
+static void make_tables(void)
+{
+	uint32_t Crc;
+	
+	for(int Byte = 0; Byte < 256; Byte++)
+	{
+		Crc = Byte;
+		for(int Bit = 0; Bit < 8; Bit++)
+			Crc = (Crc >> 1) ^ ((Crc & 1) ? CRC32C_POLY : 0);
+		Table[0][Byte] = Crc;
+	}
+	
+	for(int Byte = 0; Byte < 256; Byte++)
+	{
+		for(int k = 1; k < 8; k++)
+			Table[k][Byte] = (Table[k - 1][Byte] >> 8) ^ Table[0][Table[k - 1][Byte] & 0xff];
+	}
+}
+
+/******************************************************************************/
+//Table variant, 8 bytes per step
+static uint32_t crc32c_slicing(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+	uint64_t	Word;
+	
+	pthread_once(&TableOnce, make_tables);
+	
+	Crc = ~Crc;
+	
+	for(; Size >= 8; Size -= 8, Data += 8)
+	{
+		memcpy(&Word, Data, 8);
+		Word ^= Crc;
+		Crc = Table[7][Word & 0xff] ^ Table[6][(Word >> 8) & 0xff] ^ Table[5][(Word >> 16) & 0xff] ^
+			  Table[4][(Word >> 24) & 0xff] ^ Table[3][(Word >> 32) & 0xff] ^ Table[2][(Word >> 40) & 0xff] ^
+			  Table[1][(Word >> 48) & 0xff] ^ Table[0][Word >> 56];
+	}
+	
+	for(; Size > 0; Size--, Data++)
+		Crc = (Crc >> 8) ^ Table[0][(Crc ^ *Data) & 0xff];
+	
+	return ~Crc;
+}
+
+/******************************************************************************/
+//SSE4.2 variant, 8 bytes per instruction
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+	uint64_t	Crc64 = ~Crc;
+	uint64_t	Word;
+	
+	for(; Size >= 8; Size -= 8, Data += 8)
+	{
+		memcpy(&Word, Data, 8);
+		Crc64 = _mm_crc32_u64(Crc64, Word);
+	}
+	
+	Crc = Crc64;
+	for(; Size > 0; Size--, Data++)
+		Crc = _mm_crc32_u8(Crc, *Data);
+	
+	return ~Crc;
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Fold bytes into a CRC32C with the best variant the CPU supports
+uint32_t crc32c(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+	if(__builtin_cpu_supports("sse4.2"))
+		return crc32c_sse42(Crc, Data, Size);
+	
+	return crc32c_slicing(Crc, Data, Size);
+}
+
+/******************************************************************************/
+//Variant picked by crc32c()
+const char *crc32c_name(void)
+{
+	return __builtin_cpu_supports("sse4.2") ? "sse4.2" : "slicing-by-8";
+}
+
+/******************************************************************************/
+//Known value of "123456789" for each variant, then the SSE4.2 variant against
+//the tables on random data of every alignment, folded in uneven pieces
+int crc32c_self_test(void)
+{
+	const uint8_t	Check[] = "123456789";
+	uint8_t			Data[1024 + 16];
+	uint32_t		Whole;
+	uint32_t		Folded;
+	int				Failed = 0;
+	
+	printf("CRC32C slicing-by-8 ... ");
+	if(crc32c_slicing(0, Check, 9) != 0xe3069283u)
+	{
+		printf("FAILED\n");
+		return -1;
+	}
+	printf("OK\n");
+	
+	printf("CRC32C sse4.2       ... ");
+	if(!__builtin_cpu_supports("sse4.2"))
+	{
+		printf("not supported by this CPU\n");
+		return 0;
+	}
+	
+	for(size_t i = 0; i < sizeof(Data); i++)
+		Data[i] = rand();
+	
+	Failed = (crc32c_sse42(0, Check, 9) != 0xe3069283u);
+	for(size_t Offset = 0; (Offset < 8) && !Failed; Offset++)
+	{
+		Whole = crc32c_slicing(0, Data + Offset, 1024);
+		Folded = crc32c_sse42(0, Data + Offset, 13 + Offset);
+		Folded = crc32c_sse42(Folded, Data + 13 + 2 * Offset, 1024 - 13 - Offset);
+		Failed = (Whole != Folded);
+	}
+	
+	printf("%s\n", Failed ? "FAILED" : "OK");
+	
+	return Failed ? -1 : 0;
+}
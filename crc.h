@@ -0,0 +1,40 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the CRC32C (Castagnoli) checksum                   *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//CRC32C uses the SSE4.2 crc32 instruction when the CPU has it, and tables
+//read 8 bytes at a time (slicing-by-8) otherwise. Both give the same result.
+
+//Reflected Castagnoli polynomial
+#define CRC32C_POLY		0x82f63b78u
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Fold Size bytes into the CRC32C of the bytes before them (0 for none)
+uint32_t crc32c(uint32_t Crc, const uint8_t *Data, size_t Size);
+//------------------------------------------------------------------------------
+//Name of the variant in use: "sse4.2" or "slicing-by-8"
+const char *crc32c_name(void);
+//------------------------------------------------------------------------------
+//Check both variants against a known value and each other, print the result.
+//Returns 0 if every check passed.
+int crc32c_self_test(void);
+
+
+#endif
@@ -0,0 +1,758 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the Reed-Solomon forward error correction of payload bytes	*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FEC_X86
+#include <immintrin.h>
+#endif
+
+#include "fec.h"
+
+
+//Field polynomial (AES). Its primitive element is x + 1, whose powers are the
+//roots of the generator polynomial.
+#define GF_POLY			0x11b
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Powers of the primitive element (twice, so sums of logs need no modulo) and
+//their logs
+static uint8_t Exp[2 * 255];
+static uint8_t Log[256];
+
+//Products of every constant with every low and high 4 bit half of a byte
+static uint8_t NibbleLow[256][16];
+static uint8_t NibbleHigh[256][16];
+
+//Dst[i] = Add[i] ^ Const * Src[i]. Dst may be Add or Src.
+typedef void (*fec_mul_add_t)(uint8_t *Dst, const uint8_t *Add, const uint8_t *Src, uint8_t Const, size_t Count);
+
+//One variant of the multiply kernel
+struct fec_kernel
+{
+	const char *Name;
+	int (*Supported)(void);
+	fec_mul_add_t MulAdd;
+};
+
+static pthread_once_t TableOnce = PTHREAD_ONCE_INIT;
+
+//Kernel in use, the best one the CPU supports once the tables are made
+static const struct fec_kernel *Kernel;
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Product of two field elements
+static uint8_t gf_mul(uint8_t A, uint8_t B)
+{
+	if((A == 0) || (B == 0))
+		return 0;
+	
+	return Exp[Log[A] + Log[B]];
+}
+
+/******************************************************************************/
+//Inverse of a non zero field element
+static uint8_t gf_inv(uint8_t A)
+{
+	return Exp[255 - Log[A]];
+}
+
+/******************************************************************************/
+//Scalar kernel, the same lookups as the vector ones
+static void mul_add_scalar(uint8_t *Dst, const uint8_t *Add, const uint8_t *Src, uint8_t Const, size_t Count)
+{
+	const uint8_t	*Low = NibbleLow[Const];
+	const uint8_t	*High = NibbleHigh[Const];
+	
+	for(size_t i = 0; i < Count; i++)
+		Dst[i] = Add[i] ^ Low[Src[i] & 0x0f] ^ High[Src[i] >> 4];
+}
+
+#ifdef FEC_X86
+/******************************************************************************/
+//SSSE3 kernel: both 4 bit halves of 16 bytes looked up with one PSHUFB each
+__attribute__((target("ssse3")))
+static void mul_add_ssse3(uint8_t *Dst, const uint8_t *Add, const uint8_t *Src, uint8_t Const, size_t Count)
+{
+	const __m128i	Low = _mm_loadu_si128((const __m128i *)NibbleLow[Const]);
+	const __m128i	High = _mm_loadu_si128((const __m128i *)NibbleHigh[Const]);
+	const __m128i	Mask = _mm_set1_epi8(0x0f);
+	
+	size_t			i;
+	__m128i			Value;
+	__m128i			Product;
+	
+	for(i = 0; i + 16 <= Count; i += 16)
+	{
+		Value = _mm_loadu_si128((const __m128i *)(Src + i));
+		Product = _mm_xor_si128(_mm_shuffle_epi8(Low, _mm_and_si128(Value, Mask)),
+								_mm_shuffle_epi8(High, _mm_and_si128(_mm_srli_epi64(Value, 4), Mask)));
+		_mm_storeu_si128((__m128i *)(Dst + i), _mm_xor_si128(Product, _mm_loadu_si128((const __m128i *)(Add + i))));
+	}
+	
+	mul_add_scalar(Dst + i, Add + i, Src + i, Const, Count - i);
+}
+
+/******************************************************************************/
+//AVX2 kernel: as SSSE3, 32 bytes at a time
+__attribute__((target("avx2")))
+static void mul_add_avx2(uint8_t *Dst, const uint8_t *Add, const uint8_t *Src, uint8_t Const, size_t Count)
+{
+	const __m256i	Low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)NibbleLow[Const]));
+	const __m256i	High = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)NibbleHigh[Const]));
+	const __m256i	Mask = _mm256_set1_epi8(0x0f);
+	
+	size_t			i;
+	__m256i			Value;
+	__m256i			Product;
+	
+	for(i = 0; i + 32 <= Count; i += 32)
+	{
+		Value = _mm256_loadu_si256((const __m256i *)(Src + i));
+		Product = _mm256_xor_si256(_mm256_shuffle_epi8(Low, _mm256_and_si256(Value, Mask)),
+								   _mm256_shuffle_epi8(High, _mm256_and_si256(_mm256_srli_epi64(Value, 4), Mask)));
+		_mm256_storeu_si256((__m256i *)(Dst + i),
+							_mm256_xor_si256(Product, _mm256_loadu_si256((const __m256i *)(Add + i))));
+	}
+	
+	mul_add_scalar(Dst + i, Add + i, Src + i, Const, Count - i);
+}
+
+/******************************************************************************/
+//GFNI kernel: 32 products in the AES field with one instruction
+__attribute__((target("gfni,avx2")))
+static void mul_add_gfni(uint8_t *Dst, const uint8_t *Add, const uint8_t *Src, uint8_t Const, size_t Count)
+{
+	const __m256i	Factor = _mm256_set1_epi8((char)Const);
+	
+	size_t			i;
+	__m256i			Product;
+	
+	for(i = 0; i + 32 <= Count; i += 32)
+	{
+		Product = _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i *)(Src + i)), Factor);
+		_mm256_storeu_si256((__m256i *)(Dst + i),
+							_mm256_xor_si256(Product, _mm256_loadu_si256((const __m256i *)(Add + i))));
+	}
+	
+	mul_add_scalar(Dst + i, Add + i, Src + i, Const, Count - i);
+}
+
+/******************************************************************************/
+//CPU feature probes
+static int cpu_has_ssse3(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+
+static int cpu_has_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static int cpu_has_gfni(void)
+{
+	return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2");
+}
+#endif
+
+static int cpu_has_nothing(void)
+{
+	return 1;
+}
+
+/******************************************************************************/
+//Kernel variants, in increasing order of preference
+static const struct fec_kernel KernelTable[] =
+{
+	{"scalar", cpu_has_nothing, mul_add_scalar},
+#ifdef FEC_X86
+	{"ssse3", cpu_has_ssse3, mul_add_ssse3},
+	{"avx2", cpu_has_avx2, mul_add_avx2},
+	{"gfni", cpu_has_gfni, mul_add_gfni},
+#endif
+};
+
+#define NUM_KERNELS		(sizeof(KernelTable) / sizeof(KernelTable[0]))
+
+/******************************************************************************/
+//Build the field tables and pick the kernel
+static void make_tables(void)
+{
+	unsigned Value = 1;
+	
+	for(int i = 0; i < 255; i++)
+	{
+		Exp[i] = Exp[i + 255] = Value;
+		Log[Value] = i;
+		
+		//Times x + 1
+		Value ^= Value << 1;
+		if(Value & 0x100)
+			Value ^= GF_POLY;
+	}
+	
+	for(int Const = 0; Const < 256; Const++)
+	{
+		for(int Half = 0; Half < 16; Half++)
+		{
+			NibbleLow[Const][Half] = gf_mul(Const, Half);
+			NibbleHigh[Const][Half] = gf_mul(Const, Half << 4);
+		}
+	}
+	
+	Kernel = &KernelTable[0];
+	for(size_t k = 1; k < NUM_KERNELS; k++)
+	{
+		if(KernelTable[k].Supported())
+			Kernel = &KernelTable[k];
+	}
+}
+
+/******************************************************************************/
+//Generator polynomial (x + a^0)(x + a^1)...(x + a^(Parity - 1)), Gen[k] being
+//the coefficient of x^k
+static void make_generator(unsigned Parity, uint8_t *Gen)
+{
+	memset(Gen, 0, Parity + 1);
+	Gen[0] = 1;
+	
+	for(unsigned Root = 0; Root < Parity; Root++)
+	{
+		for(unsigned k = Root + 1; k > 0; k--)
+			Gen[k] = Gen[k - 1] ^ gf_mul(Gen[k], Exp[Root]);
+		Gen[0] = gf_mul(Gen[0], Exp[Root]);
+	}
+}
+
+/******************************************************************************/
+//Codewords of a group of StoredSize bytes, 0 if no data fits
+static unsigned group_codewords(uint64_t StoredSize, unsigned Parity)
+{
+	unsigned Codewords = (StoredSize + FEC_CODEWORD - 1) / FEC_CODEWORD;
+	
+	return (StoredSize > (uint64_t)Codewords * Parity) ? Codewords : 0;
+}
+
+/******************************************************************************/
+//Encode the Size data bytes of one group. Row j of the group is byte j of
+//every codeword, and the codewords are encoded side by side: one multiply
+//kernel call per generator coefficient and row updates the division remainder
+//of every codeword at once.
+static uint64_t encode_group(const uint8_t *Data, uint64_t Size, unsigned Parity, const uint8_t *Gen, uint8_t *Output)
+{
+	unsigned	Codewords = (Size + (FEC_CODEWORD - Parity) - 1) / (FEC_CODEWORD - Parity);
+	unsigned	Rows = (Size + Codewords - 1) / Codewords;
+	uint8_t		Row[FEC_GROUP_CODEWORDS];
+	uint8_t		Feedback[FEC_GROUP_CODEWORDS];
+	uint8_t		Zero[FEC_GROUP_CODEWORDS] = {0};
+	uint8_t		*Remainder[FEC_MAX_PARITY];
+	
+	memcpy(Output, Data, Size);
+	
+	//Remainder coefficient k is parity row Parity - 1 - k, so the rows of a
+	//codeword go from its highest power of x down to x^0
+	for(unsigned k = 0; k < Parity; k++)
+	{
+		Remainder[k] = Output + Size + (uint64_t)(Parity - 1 - k) * Codewords;
+		memset(Remainder[k], 0, Codewords);
+	}
+	
+	for(unsigned j = 0; j < Rows; j++)
+	{
+		//Codewords with no byte in the last row take a zero
+		memset(Row, 0, Codewords);
+		memcpy(Row, Data + (uint64_t)j * Codewords, (Size - (uint64_t)j * Codewords < Codewords) ?
+			   Size - (uint64_t)j * Codewords : Codewords);
+		
+		Kernel->MulAdd(Feedback, Row, Remainder[Parity - 1], 1, Codewords);
+		
+		for(unsigned k = Parity - 1; k > 0; k--)
+			Kernel->MulAdd(Remainder[k], Remainder[k - 1], Feedback, Gen[k], Codewords);
+		Kernel->MulAdd(Remainder[0], Zero, Feedback, Gen[0], Codewords);
+	}
+	
+	return Size + (uint64_t)Codewords * Parity;
+}
+
+/******************************************************************************/
+//Repair one codeword from its syndromes: Berlekamp-Massey for the error locator,
+//Chien search for its roots and Forney for the error values. Symbol j of the
+//codeword (NumSymbols in all) is the coefficient of x^(NumSymbols - 1 - j) and
+//lives at Symbol[j]. Returns the number of bytes repaired or -1.
+static int repair_codeword(const uint8_t *Syndrome, unsigned Parity, uint8_t **Symbol, unsigned NumSymbols)
+{
+	uint8_t		Locator[FEC_MAX_PARITY + 1] = {1};
+	uint8_t		Previous[FEC_MAX_PARITY + 1] = {1};
+	uint8_t		Saved[FEC_MAX_PARITY + 1];
+	uint8_t		Evaluator[FEC_MAX_PARITY];
+	uint8_t		Position[FEC_MAX_PARITY];
+	uint8_t		Value[FEC_MAX_PARITY];
+	unsigned	Length = 0;
+	unsigned	Shift = 1;
+	uint8_t		LastDiscrepancy = 1;
+	uint8_t		Discrepancy;
+	uint8_t		Scale;
+	uint8_t		Sum;
+	uint8_t		Derivative;
+	unsigned	NumErrors = 0;
+	unsigned	Inverse;
+	
+	for(unsigned n = 0; n < Parity; n++)
+	{
+		Discrepancy = Syndrome[n];
+		for(unsigned i = 1; i <= Length; i++)
+			Discrepancy ^= gf_mul(Locator[i], Syndrome[n - i]);
+		
+		if(Discrepancy == 0)
+		{
+			Shift++;
+			continue;
+		}
+		
+		Scale = gf_mul(Discrepancy, gf_inv(LastDiscrepancy));
+		memcpy(Saved, Locator, sizeof(Locator));
+		for(unsigned i = 0; i + Shift <= Parity; i++)
+			Locator[i + Shift] ^= gf_mul(Scale, Previous[i]);
+		
+		if(2 * Length <= n)
+		{
+			Length = n + 1 - Length;
+			memcpy(Previous, Saved, sizeof(Previous));
+			LastDiscrepancy = Discrepancy;
+			Shift = 1;
+		}
+		else
+			Shift++;
+	}
+	
+	if(2 * Length > Parity)
+		return -1;
+	
+	//Errors are where the locator has a root, x^-Power for the symbol of x^Power
+	for(unsigned Power = 0; (Power < NumSymbols) && (NumErrors <= Length); Power++)
+	{
+		Inverse = (255 - Power) % 255;
+		Sum = 0;
+		for(unsigned i = 0; i <= Length; i++)
+			Sum ^= gf_mul(Locator[i], Exp[(Inverse * i) % 255]);
+		
+		if(Sum == 0)
+		{
+			if(NumErrors == Length)
+				return -1;
+			Position[NumErrors++] = Power;
+		}
+	}
+	
+	if(NumErrors != Length)
+		return -1;
+	
+	//Evaluator = Syndrome(x) * Locator(x) mod x^Parity
+	for(unsigned k = 0; k < Parity; k++)
+	{
+		Evaluator[k] = 0;
+		for(unsigned i = 0; (i <= k) && (i <= Length); i++)
+			Evaluator[k] ^= gf_mul(Locator[i], Syndrome[k - i]);
+	}
+	
+	//Value = X * Evaluator(1/X) / Locator'(1/X), X = a^Power
+	for(unsigned e = 0; e < NumErrors; e++)
+	{
+		Inverse = (255 - Position[e]) % 255;
+		
+		Sum = 0;
+		for(unsigned k = 0; k < Parity; k++)
+			Sum ^= gf_mul(Evaluator[k], Exp[(Inverse * k) % 255]);
+		
+		//Formal derivative: only the odd powers remain
+		Derivative = 0;
+		for(unsigned i = 1; i <= Length; i += 2)
+			Derivative ^= gf_mul(Locator[i], Exp[(Inverse * (i - 1)) % 255]);
+		
+		if((Derivative == 0) || (Symbol[NumSymbols - 1 - Position[e]] == NULL))
+			return -1;
+		
+		Value[e] = gf_mul(Exp[Position[e]], gf_mul(Sum, gf_inv(Derivative)));
+	}
+	
+	for(unsigned e = 0; e < NumErrors; e++)
+		*Symbol[NumSymbols - 1 - Position[e]] ^= Value[e];
+	
+	return NumErrors;
+}
+
+/******************************************************************************/
+//Repair the codewords of one group of StoredSize bytes. The syndromes of every
+//codeword are evaluated side by side (Horner's rule, one multiply kernel call
+//per syndrome and row) and only codewords with a non zero one are decoded.
+static int64_t decode_group(uint8_t *Stored, uint64_t StoredSize, unsigned Parity)
+{
+	unsigned	Codewords = group_codewords(StoredSize, Parity);
+	uint64_t	Size = StoredSize - (uint64_t)Codewords * Parity;
+	unsigned	Rows = (Size + Codewords - 1) / Codewords;
+	unsigned	NumSymbols = Rows + Parity;
+	uint8_t		Syndrome[FEC_MAX_PARITY][FEC_GROUP_CODEWORDS];
+	uint8_t		Row[FEC_GROUP_CODEWORDS];
+	uint8_t		Codeword[FEC_MAX_PARITY];
+	uint8_t		*Symbol[FEC_CODEWORD];
+	const uint8_t	*Source;
+	int64_t		Repaired = 0;
+	int			Result;
+	
+	if(Codewords == 0)
+		return -1;
+	
+	for(unsigned k = 0; k < Parity; k++)
+		memset(Syndrome[k], 0, Codewords);
+	
+	for(unsigned j = 0; j < NumSymbols; j++)
+	{
+		if(j >= Rows)
+			Source = Stored + Size + (uint64_t)(j - Rows) * Codewords;
+		else if((uint64_t)(j + 1) * Codewords > Size)
+		{
+			memset(Row, 0, Codewords);
+			memcpy(Row, Stored + (uint64_t)j * Codewords, Size - (uint64_t)j * Codewords);
+			Source = Row;
+		}
+		else
+			Source = Stored + (uint64_t)j * Codewords;
+		
+		for(unsigned k = 0; k < Parity; k++)
+			Kernel->MulAdd(Syndrome[k], Source, Syndrome[k], Exp[k], Codewords);
+	}
+	
+	for(unsigned i = 0; i < Codewords; i++)
+	{
+		Result = 0;
+		for(unsigned k = 0; k < Parity; k++)
+		{
+			Codeword[k] = Syndrome[k][i];
+			Result |= Codeword[k];
+		}
+		if(Result == 0)
+			continue;
+		
+		//Bytes of the codeword, NULL for the zero taken in a short last row
+		for(unsigned j = 0; j < NumSymbols; j++)
+		{
+			if(j >= Rows)
+				Symbol[j] = Stored + Size + (uint64_t)(j - Rows) * Codewords + i;
+			else
+				Symbol[j] = ((uint64_t)j * Codewords + i < Size) ? Stored + (uint64_t)j * Codewords + i : NULL;
+		}
+		
+		Result = repair_codeword(Codeword, Parity, Symbol, NumSymbols);
+		if((Result < 0) || (Repaired < 0))
+			Repaired = -1;
+		else
+			Repaired += Result;
+	}
+	
+	return Repaired;
+}
+
+/******************************************************************************/
+//Small xorshift generator for the self test
+static uint64_t self_test_random(uint64_t *State)
+{
+	*State ^= *State << 13;
+	*State ^= *State >> 7;
+	*State ^= *State << 17;
+	return *State;
+}
+
+/******************************************************************************/
+//Damage PerCodeword random bytes of every codeword, for the self test
+static void self_test_damage(uint8_t *Stored, uint64_t StoredSize, unsigned Parity, unsigned PerCodeword,
+							 uint64_t *State)
+{
+	uint64_t	Count;
+	uint64_t	Size;
+	unsigned	Codewords;
+	unsigned	Rows;
+	unsigned	Row;
+	
+	for(uint64_t Done = 0; Done < StoredSize; Done += Count)
+	{
+		Count = (StoredSize - Done < FEC_GROUP_SIZE) ? (StoredSize - Done) : FEC_GROUP_SIZE;
+		Codewords = group_codewords(Count, Parity);
+		Size = Count - (uint64_t)Codewords * Parity;
+		Rows = (Size + Codewords - 1) / Codewords;
+		
+		//Bytes are picked at random rows, a row picked twice damages less
+		for(unsigned i = 0; i < Codewords; i++)
+		{
+			for(unsigned e = 0; e < PerCodeword; e++)
+			{
+				Row = self_test_random(State) % (Rows + Parity);
+				if(Row >= Rows)
+					Stored[Done + Size + (uint64_t)(Row - Rows) * Codewords + i] ^= 1 + self_test_random(State) % 255;
+				else if((uint64_t)Row * Codewords + i < Size)
+					Stored[Done + (uint64_t)Row * Codewords + i] ^= 1 + self_test_random(State) % 255;
+			}
+		}
+	}
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Name of the kernel in use
+const char *fec_kernel_name(void)
+{
+	pthread_once(&TableOnce, make_tables);
+	
+	return Kernel->Name;
+}
+
+/******************************************************************************/
+//Stored size: whole groups, then the data and parity of the last one
+uint64_t fec_encoded_size(uint64_t Size, unsigned Parity)
+{
+	uint64_t	Rest = Size % FEC_GROUP_DATA(Parity);
+	uint64_t	Codewords = (Rest + (FEC_CODEWORD - Parity) - 1) / (FEC_CODEWORD - Parity);
+	
+	return Size / FEC_GROUP_DATA(Parity) * FEC_GROUP_SIZE + Rest + Codewords * Parity;
+}
+
+/******************************************************************************/
+//Max data bytes: whole groups, whole codewords, then a short codeword
+uint64_t fec_capacity(uint64_t StoredSize, unsigned Parity)
+{
+	uint64_t	Rest = StoredSize % FEC_GROUP_SIZE;
+	uint64_t	Size = StoredSize / FEC_GROUP_SIZE * FEC_GROUP_DATA(Parity);
+	
+	Size += Rest / FEC_CODEWORD * (FEC_CODEWORD - Parity);
+	if(Rest % FEC_CODEWORD > Parity)
+		Size += Rest % FEC_CODEWORD - Parity;
+	
+	return Size;
+}
+
+/******************************************************************************/
+//Encode a group at a time
+uint64_t fec_encode(const uint8_t *Data, uint64_t Size, unsigned Parity, uint8_t *Output)
+{
+	uint8_t		Gen[FEC_MAX_PARITY + 1];
+	uint64_t	StoredSize = 0;
+	uint64_t	Count;
+	
+	pthread_once(&TableOnce, make_tables);
+	make_generator(Parity, Gen);
+	
+	for(uint64_t Done = 0; Done < Size; Done += Count)
+	{
+		Count = (Size - Done < FEC_GROUP_DATA(Parity)) ? (Size - Done) : FEC_GROUP_DATA(Parity);
+		StoredSize += encode_group(Data + Done, Count, Parity, Gen, Output + StoredSize);
+	}
+	
+	return StoredSize;
+}
+
+/******************************************************************************/
+//Repair a group at a time
+int64_t fec_decode(uint8_t *Stored, uint64_t StoredSize, unsigned Parity)
+{
+	int64_t		Repaired = 0;
+	int64_t		Result;
+	uint64_t	Count;
+	
+	pthread_once(&TableOnce, make_tables);
+	
+	for(uint64_t Done = 0; Done < StoredSize; Done += Count)
+	{
+		Count = (StoredSize - Done < FEC_GROUP_SIZE) ? (StoredSize - Done) : FEC_GROUP_SIZE;
+		
+		Result = decode_group(Stored + Done, Count, Parity);
+		if((Result < 0) || (Repaired < 0))
+			Repaired = -1;
+		else
+			Repaired += Result;
+	}
+	
+	return Repaired;
+}
+
+/******************************************************************************/
+//Drop the parity bytes of every group
+uint64_t fec_compact(uint8_t *Stored, uint64_t StoredSize, unsigned Parity)
+{
+	uint64_t	Size = 0;
+	uint64_t	Count;
+	uint64_t	GroupData;
+	
+	for(uint64_t Done = 0; Done < StoredSize; Done += Count)
+	{
+		Count = (StoredSize - Done < FEC_GROUP_SIZE) ? (StoredSize - Done) : FEC_GROUP_SIZE;
+		GroupData = Count - (uint64_t)group_codewords(Count, Parity) * Parity;
+		
+		memmove(Stored + Size, Stored + Done, GroupData);
+		Size += GroupData;
+	}
+	
+	return Size;
+}
+
+/******************************************************************************/
+//Encode a file one group at a time
+int64_t fec_encode_file(FILE *Input, FILE *Output, unsigned Parity)
+{
+	uint8_t		*Group = malloc(FEC_GROUP_DATA(Parity));
+	uint8_t		*Encoded = malloc(FEC_GROUP_SIZE);
+	int64_t		OutputSize = 0;
+	size_t		Count;
+	size_t		EncodedSize;
+	
+	if((Group == NULL) || (Encoded == NULL))
+		OutputSize = -1;
+	
+	while((OutputSize >= 0) && ((Count = fread(Group, 1, FEC_GROUP_DATA(Parity), Input)) > 0))
+	{
+		EncodedSize = fec_encode(Group, Count, Parity, Encoded);
+		if(fwrite(Encoded, 1, EncodedSize, Output) != EncodedSize)
+			OutputSize = -1;
+		else
+			OutputSize += EncodedSize;
+	}
+	
+	if(ferror(Input))
+		OutputSize = -1;
+	
+	free(Group);
+	free(Encoded);
+	
+	return OutputSize;
+}
+
+/******************************************************************************/
+//Kernels against the log tables on random runs, then the codec with random
+//damage up to Parity / 2 bytes per codeword, and a long run of damaged bytes
+int fec_self_test(void)
+{
+	const unsigned	Parities[] = {2, 7, 16, 32, 128};
+	const uint64_t	Sizes[] = {1, 200, 5000, FEC_GROUP_DATA(32) + 777, 3 * FEC_GROUP_DATA(16)};
+	
+	uint8_t			Src[1000];
+	uint8_t			Add[1000];
+	uint8_t			Result[1000];
+	uint8_t			Reference[1000];
+	uint8_t			*Data;
+	uint8_t			*Stored;
+	uint64_t		State = 0x9E3779B97F4A7C15;
+	uint64_t		Size;
+	uint64_t		StoredSize;
+	uint64_t		Group;
+	uint64_t		Run;
+	uint64_t		Byte;
+	size_t			Count;
+	uint8_t			Const;
+	unsigned		Parity;
+	int				Mismatch;
+	int				Failures = 0;
+	
+	pthread_once(&TableOnce, make_tables);
+	
+	for(size_t k = 0; k < NUM_KERNELS; k++)
+	{
+		printf("FEC kernel %-6s ... ", KernelTable[k].Name);
+		if(!KernelTable[k].Supported())
+		{
+			printf("not supported by this CPU\n");
+			continue;
+		}
+		
+		Mismatch = 0;
+		for(int test = 0; (test < 500) && !Mismatch; test++)
+		{
+			for(size_t i = 0; i < sizeof(Src); i++)
+			{
+				Src[i] = self_test_random(&State);
+				Add[i] = self_test_random(&State);
+			}
+			Const = self_test_random(&State);
+			Count = self_test_random(&State) % sizeof(Src);
+			
+			memcpy(Reference, Add, sizeof(Add));
+			memcpy(Result, Add, sizeof(Add));
+			for(size_t i = 0; i < Count; i++)
+				Reference[i] ^= gf_mul(Const, Src[i]);
+			KernelTable[k].MulAdd(Result, Add, Src, Const, Count);
+			Mismatch = memcmp(Reference, Result, sizeof(Result));
+		}
+		
+		printf("%s\n", Mismatch ? "FAILED" : "OK");
+		Failures += (Mismatch != 0);
+	}
+	
+	printf("Reed-Solomon      ... ");
+	Data = malloc(Sizes[4]);
+	Stored = malloc(fec_encoded_size(Sizes[4], FEC_MAX_PARITY));
+	if((Data == NULL) || (Stored == NULL))
+	{
+		printf("Error: could not allocate memory for FEC self test\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	Mismatch = 0;
+	for(size_t p = 0; (p < sizeof(Parities) / sizeof(Parities[0])) && !Mismatch; p++)
+	{
+		for(size_t s = 0; (s < sizeof(Sizes) / sizeof(Sizes[0])) && !Mismatch; s++)
+		{
+			Parity = Parities[p];
+			Size = Sizes[s];
+			for(uint64_t i = 0; i < Size; i++)
+				Data[i] = self_test_random(&State);
+			
+			StoredSize = fec_encode(Data, Size, Parity, Stored);
+			Mismatch |= (StoredSize != fec_encoded_size(Size, Parity)) || (fec_capacity(StoredSize, Parity) != Size);
+			
+			//Parity / 2 random bytes of every codeword, then a run of bytes
+			//as long as a group can repair
+			self_test_damage(Stored, StoredSize, Parity, Parity / 2, &State);
+			Mismatch |= (fec_decode(Stored, StoredSize, Parity) < 0) ||
+						(fec_compact(Stored, StoredSize, Parity) != Size) || (memcmp(Data, Stored, Size) != 0);
+			
+			//A codeword can have two bytes closer than a row where the data
+			//ends, hence one row less than Parity / 2
+			fec_encode(Data, Size, Parity, Stored);
+			Group = (StoredSize < FEC_GROUP_SIZE) ? StoredSize : FEC_GROUP_SIZE;
+			Run = (Parity / 2 - 1) * group_codewords(Group, Parity);
+			if(Run == 0)
+				Run = 1;
+			Byte = self_test_random(&State) % (Group - Run + 1);
+			for(uint64_t i = 0; i < Run; i++)
+				Stored[Byte + i] = ~Stored[Byte + i];
+			Mismatch |= (fec_decode(Stored, StoredSize, Parity) < 0) ||
+						(fec_compact(Stored, StoredSize, Parity) != Size) || (memcmp(Data, Stored, Size) != 0);
+		}
+	}
+	
+	printf("%s\n", Mismatch ? "FAILED" : "OK");
+	Failures += (Mismatch != 0);
+	
+	free(Data);
+	free(Stored);
+	
+	return Failures ? -1 : 0;
+}
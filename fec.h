@@ -0,0 +1,79 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the Reed-Solomon forward error correction of       *
+ * payload bytes                                                     *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __FEC_H__
+#define __FEC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Bytes are encoded in groups of up to FEC_GROUP_CODEWORDS Reed-Solomon
+//codewords over GF(2^8), each of at most FEC_CODEWORD bytes of which Parity are
+//parity bytes, correcting up to Parity / 2 damaged bytes.
+//
+//Codeword i of a group of C codewords takes the data bytes i, i + C, i + 2C ...
+//of the group, so a run of damaged bytes is spread over every codeword. The
+//data bytes of a group are stored as they are, followed by the parity bytes
+//in the same interleaved order. Only the last group and its codewords can be
+//shorter.
+//
+//The field uses the AES polynomial (x^8 + x^4 + x^3 + x + 1), which GFNI
+//multiplies natively. Other CPUs multiply with PSHUFB lookups of 4 bit halves.
+
+#define FEC_CODEWORD			255		//Max bytes in a codeword
+#define FEC_GROUP_CODEWORDS		256		//Max codewords in a group
+#define FEC_MAX_PARITY			128		//Max parity bytes per codeword
+
+//Stored bytes of a whole group, the same for every number of parity bytes
+#define FEC_GROUP_SIZE			(FEC_GROUP_CODEWORDS * FEC_CODEWORD)
+
+//Data bytes of a whole group
+#define FEC_GROUP_DATA(Parity)	((uint64_t)FEC_GROUP_CODEWORDS * (FEC_CODEWORD - (Parity)))
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Name of the GF(2^8) multiply kernel in use ("scalar", "ssse3", "avx2", "gfni")
+const char *fec_kernel_name(void);
+//------------------------------------------------------------------------------
+//Stored size of Size data bytes
+uint64_t fec_encoded_size(uint64_t Size, unsigned Parity);
+//------------------------------------------------------------------------------
+//Max data bytes that can be stored in StoredSize bytes
+uint64_t fec_capacity(uint64_t StoredSize, unsigned Parity);
+//------------------------------------------------------------------------------
+//Encode Size data bytes into Output (fec_encoded_size() bytes). Data must start
+//on a group boundary of the whole payload. Returns the stored size.
+uint64_t fec_encode(const uint8_t *Data, uint64_t Size, unsigned Parity, uint8_t *Output);
+//------------------------------------------------------------------------------
+//Repair StoredSize stored bytes in place (whole groups, but for the last one
+//of the payload). Returns the number of bytes repaired, or -1 if any codeword
+//has more damage than it can repair (the others are still repaired).
+int64_t fec_decode(uint8_t *Stored, uint64_t StoredSize, unsigned Parity);
+//------------------------------------------------------------------------------
+//Move the data bytes of StoredSize stored bytes to the front, dropping the
+//parity. Returns the number of data bytes.
+uint64_t fec_compact(uint8_t *Stored, uint64_t StoredSize, unsigned Parity);
+//------------------------------------------------------------------------------
+//Encode a whole file, a group at a time. Returns the stored size, or -1 on
+//read or write errors.
+int64_t fec_encode_file(FILE *Input, FILE *Output, unsigned Parity);
+//------------------------------------------------------------------------------
+//Check every multiply kernel the CPU supports against the log tables, then
+//repair random damage up to the limit, print the results. Returns 0 if every
+//check passed.
+int fec_self_test(void);
+
+
+#endif
@@ -0,0 +1,1487 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code to hide and recover bits in the least significant bit (LSB) of	*
+ * pixel channels																*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LSB_X86
+#include <immintrin.h>
+#endif
+
+#include "lsb.h"
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Scalar reference kernel: one channel per iteration
+static void lsb_embed_scalar(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit)
+{
+	uint64_t	Bit;
+	uint8_t		NewValue;
+	
+	for(size_t i = 0; i < Count; i++)
+	{
+		Bit = FirstBit + i;
+		NewValue = (Channel[i] & 0xFE) | ((Payload[Bit >> 3] >> (Bit & 7)) & 1);
+		
+		//Leave untouched bytes clean (matters for images mapped from file)
+		if(NewValue != Channel[i])
+			Channel[i] = NewValue;
+	}
+}
+
+/******************************************************************************/
+//Scalar reference kernel: one channel per iteration
+static void lsb_extract_scalar(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit)
+{
+	uint64_t	Bit;
+	
+	for(size_t i = 0; i < Count; i++)
+	{
+		Bit = FirstBit + i;
+		
+		if(Channel[i] & 1)
+			Payload[Bit >> 3] |= (uint8_t)(1 << (Bit & 7));
+		else
+			Payload[Bit >> 3] &= (uint8_t)~(1 << (Bit & 7));
+	}
+}
+
+#ifdef LSB_X86
+/******************************************************************************/
+//SSE2 kernel: 16 payload bits spread over 16 channels per iteration. Without
+//pshufb the 2 payload bytes are widened to 8 copies each by unpacking.
+static void lsb_embed_sse2(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit)
+{
+	const __m128i	BitSelect = _mm_set1_epi64x(0x8040201008040201);
+	const __m128i	One = _mm_set1_epi8(1);
+	const __m128i	ClearLSB = _mm_set1_epi8((char)0xFE);
+	
+	size_t			i;
+	uint16_t		Bits16;
+	__m128i			Bits;
+	__m128i			Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_embed_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 16 <= Count; i += 16)
+	{
+		memcpy(&Bits16, Payload + ((FirstBit + i) >> 3), sizeof(Bits16));
+		
+		Bits = _mm_cvtsi32_si128(Bits16);
+		Bits = _mm_unpacklo_epi8(Bits, Bits);
+		Bits = _mm_unpacklo_epi16(Bits, Bits);
+		Bits = _mm_unpacklo_epi32(Bits, Bits);
+		Bits = _mm_min_epu8(_mm_and_si128(Bits, BitSelect), One);
+		
+		Value = _mm_loadu_si128((const __m128i *)(Channel + i));
+		Value = _mm_or_si128(_mm_and_si128(Value, ClearLSB), Bits);
+		_mm_storeu_si128((__m128i *)(Channel + i), Value);
+	}
+	
+	//Scalar tail
+	lsb_embed_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//AVX2 kernel: 32 payload bits spread over 32 channels per iteration. Every
+//channel in the range is stored, so all pages covering the payload get dirty.
+__attribute__((target("avx2")))
+static void lsb_embed_avx2(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit)
+{
+	//Byte i of a 16 byte lane picks payload byte i/8 and keeps its bit i%8
+	const __m256i	Spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+											  2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i	BitSelect = _mm256_set1_epi64x(0x8040201008040201);
+	const __m256i	One = _mm256_set1_epi8(1);
+	const __m256i	ClearLSB = _mm256_set1_epi8((char)0xFE);
+	
+	size_t			i;
+	uint32_t		Bits32;
+	__m256i			Bits;
+	__m256i			Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_embed_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 32 <= Count; i += 32)
+	{
+		memcpy(&Bits32, Payload + ((FirstBit + i) >> 3), sizeof(Bits32));
+		
+		//Broadcast the 4 payload bytes, move byte i/8 to channel i, isolate bit
+		//i%8 and turn it into 0 or 1
+		Bits = _mm256_shuffle_epi8(_mm256_set1_epi32((int)Bits32), Spread);
+		Bits = _mm256_min_epu8(_mm256_and_si256(Bits, BitSelect), One);
+		
+		Value = _mm256_loadu_si256((const __m256i *)(Channel + i));
+		Value = _mm256_or_si256(_mm256_and_si256(Value, ClearLSB), Bits);
+		_mm256_storeu_si256((__m256i *)(Channel + i), Value);
+	}
+	
+	//Scalar tail
+	lsb_embed_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//SSE2 kernel: shifting each channel left by 7 moves its LSB to the byte sign
+//bit, pmovmskb then gathers 16 payload bits in one instruction
+static void lsb_extract_sse2(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit)
+{
+	size_t		i;
+	uint16_t	Bits16;
+	__m128i		Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_extract_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 16 <= Count; i += 16)
+	{
+		Value = _mm_loadu_si128((const __m128i *)(Channel + i));
+		Bits16 = (uint16_t)_mm_movemask_epi8(_mm_slli_epi16(Value, 7));
+		memcpy(Payload + ((FirstBit + i) >> 3), &Bits16, sizeof(Bits16));
+	}
+	
+	//Scalar tail
+	lsb_extract_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//AVX2 kernel: same as the SSE2 kernel with 32 payload bits per instruction
+__attribute__((target("avx2")))
+static void lsb_extract_avx2(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit)
+{
+	size_t		i;
+	uint32_t	Bits32;
+	__m256i		Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_extract_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 32 <= Count; i += 32)
+	{
+		Value = _mm256_loadu_si256((const __m256i *)(Channel + i));
+		Bits32 = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(Value, 7));
+		memcpy(Payload + ((FirstBit + i) >> 3), &Bits32, sizeof(Bits32));
+	}
+	
+	//Scalar tail
+	lsb_extract_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//AVX-512BW kernel: 8 payload bytes are used directly as a 64 bit byte mask
+__attribute__((target("avx512f,avx512bw")))
+static void lsb_embed_avx512(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit)
+{
+	const __m512i	One = _mm512_set1_epi8(1);
+	const __m512i	ClearLSB = _mm512_set1_epi8((char)0xFE);
+	
+	size_t			i;
+	uint64_t		Bits64;
+	__m512i			Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_embed_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 64 <= Count; i += 64)
+	{
+		memcpy(&Bits64, Payload + ((FirstBit + i) >> 3), sizeof(Bits64));
+		
+		Value = _mm512_loadu_si512((const void *)(Channel + i));
+		Value = _mm512_or_si512(_mm512_and_si512(Value, ClearLSB), _mm512_maskz_mov_epi8(Bits64, One));
+		_mm512_storeu_si512((void *)(Channel + i), Value);
+	}
+	
+	//Scalar tail
+	lsb_embed_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//AVX-512BW kernel: vptestmb gathers 64 payload bits per instruction
+__attribute__((target("avx512f,avx512bw")))
+static void lsb_extract_avx512(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit)
+{
+	const __m512i	One = _mm512_set1_epi8(1);
+	
+	size_t			i;
+	uint64_t		Bits64;
+	__m512i			Value;
+	
+	//Scalar head until the payload bit is byte aligned
+	i = (8 - (FirstBit & 7)) & 7;
+	if(i > Count)
+		i = Count;
+	lsb_extract_scalar(Channel, i, Payload, FirstBit);
+	
+	for(; i + 64 <= Count; i += 64)
+	{
+		Value = _mm512_loadu_si512((const void *)(Channel + i));
+		Bits64 = _mm512_test_epi8_mask(Value, One);
+		memcpy(Payload + ((FirstBit + i) >> 3), &Bits64, sizeof(Bits64));
+	}
+	
+	//Scalar tail
+	lsb_extract_scalar(Channel + i, Count - i, Payload, FirstBit + i);
+}
+
+/******************************************************************************/
+//CPU feature probes (CPUID is read once by the compiler runtime at startup)
+static int cpu_has_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static int cpu_has_avx512(void)
+{
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+
+static int cpu_has_ssse3(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+#endif
+
+static int cpu_has_nothing(void)
+{
+	return 1;
+}
+
+/******************************************************************************/
+//Density format kernels. One generic body is written once and forced inline
+//into a function per (bits, channels) combination, so the channel selection
+//and field width are constants and no per channel branch is left.
+
+//Payload bits read ahead of the channels that store them
+struct bit_reader
+{
+	const uint8_t *Next;
+	uint32_t Acc;
+	unsigned NumAcc;
+};
+
+//Payload bits gathered until a whole byte can be written
+struct bit_writer
+{
+	uint8_t *Next;
+	uint32_t Acc;
+	unsigned NumAcc;
+};
+
+static inline __attribute__((always_inline))
+void embed_field(uint8_t *Channel, struct bit_reader *Reader, unsigned Take)
+{
+	uint8_t		Field = (1 << Take) - 1;
+	uint8_t		NewValue;
+	
+	if(Reader->NumAcc < Take)
+	{
+		Reader->Acc |= (uint32_t)*Reader->Next++ << Reader->NumAcc;
+		Reader->NumAcc += 8;
+	}
+	
+	NewValue = (*Channel & ~Field) | (Reader->Acc & Field);
+	if(NewValue != *Channel)
+		*Channel = NewValue;
+	
+	Reader->Acc >>= Take;
+	Reader->NumAcc -= Take;
+}
+
+static inline __attribute__((always_inline))
+void extract_field(uint8_t Channel, struct bit_writer *Writer, unsigned Take)
+{
+	Writer->Acc |= (uint32_t)(Channel & ((1 << Take) - 1)) << Writer->NumAcc;
+	Writer->NumAcc += Take;
+	
+	if(Writer->NumAcc >= 8)
+	{
+		*Writer->Next++ = (uint8_t)Writer->Acc;
+		Writer->Acc >>= 8;
+		Writer->NumAcc -= 8;
+	}
+}
+
+static inline __attribute__((always_inline))
+void format_embed(uint8_t *Channel, size_t Count, unsigned Phase, const uint8_t *Payload,
+				  uint64_t FirstBit, uint64_t NumBits, const unsigned Bits, const unsigned Channels)
+{
+	const uint64_t		PixelBits = Bits * __builtin_popcount(Channels);
+	struct bit_reader	Reader;
+	unsigned			Take;
+	size_t				i = 0;
+	
+	if(NumBits == 0)
+		return;
+	
+	Reader.Next = Payload + (FirstBit >> 3);
+	Reader.Acc = *Reader.Next++ >> (FirstBit & 7);
+	Reader.NumAcc = 8 - (FirstBit & 7);
+	
+	//Head, up to the next whole pixel
+	for(; (i < Count) && (Phase != 0) && (NumBits > 0); i++, Phase = (Phase + 1) % 3)
+	{
+		if(Channels & (1 << Phase))
+		{
+			Take = (NumBits < Bits) ? NumBits : Bits;
+			embed_field(Channel + i, &Reader, Take);
+			NumBits -= Take;
+		}
+	}
+	
+	//Whole pixels, channel selection known at compile time
+	for(; (i + 3 <= Count) && (NumBits >= PixelBits); i += 3, NumBits -= PixelBits)
+	{
+		if(Channels & LSB_BLUE)
+			embed_field(Channel + i, &Reader, Bits);
+		if(Channels & LSB_GREEN)
+			embed_field(Channel + i + 1, &Reader, Bits);
+		if(Channels & LSB_RED)
+			embed_field(Channel + i + 2, &Reader, Bits);
+	}
+	
+	//Tail, the last field may be partial
+	for(Phase = 0; (i < Count) && (NumBits > 0); i++, Phase++)
+	{
+		if(Channels & (1 << Phase))
+		{
+			Take = (NumBits < Bits) ? NumBits : Bits;
+			embed_field(Channel + i, &Reader, Take);
+			NumBits -= Take;
+		}
+	}
+}
+
+static inline __attribute__((always_inline))
+void format_extract(const uint8_t *Channel, size_t Count, unsigned Phase, uint8_t *Payload,
+					uint64_t FirstBit, uint64_t NumBits, const unsigned Bits, const unsigned Channels)
+{
+	const uint64_t		PixelBits = Bits * __builtin_popcount(Channels);
+	struct bit_writer	Writer;
+	unsigned			Take;
+	size_t				i = 0;
+	
+	if(NumBits == 0)
+		return;
+	
+	//Bits of the first byte before FirstBit are kept
+	Writer.Next = Payload + (FirstBit >> 3);
+	Writer.NumAcc = FirstBit & 7;
+	Writer.Acc = *Writer.Next & ((1 << Writer.NumAcc) - 1);
+	
+	//Head, up to the next whole pixel
+	for(; (i < Count) && (Phase != 0) && (NumBits > 0); i++, Phase = (Phase + 1) % 3)
+	{
+		if(Channels & (1 << Phase))
+		{
+			Take = (NumBits < Bits) ? NumBits : Bits;
+			extract_field(Channel[i], &Writer, Take);
+			NumBits -= Take;
+		}
+	}
+	
+	//Whole pixels, channel selection known at compile time
+	for(; (i + 3 <= Count) && (NumBits >= PixelBits); i += 3, NumBits -= PixelBits)
+	{
+		if(Channels & LSB_BLUE)
+			extract_field(Channel[i], &Writer, Bits);
+		if(Channels & LSB_GREEN)
+			extract_field(Channel[i + 1], &Writer, Bits);
+		if(Channels & LSB_RED)
+			extract_field(Channel[i + 2], &Writer, Bits);
+	}
+	
+	//Tail, the last field may be partial
+	for(Phase = 0; (i < Count) && (NumBits > 0); i++, Phase++)
+	{
+		if(Channels & (1 << Phase))
+		{
+			Take = (NumBits < Bits) ? NumBits : Bits;
+			extract_field(Channel[i], &Writer, Take);
+			NumBits -= Take;
+		}
+	}
+	
+	//Bits of the last byte after the payload range are kept
+	if(Writer.NumAcc > 0)
+		*Writer.Next = (*Writer.Next & ~((1 << Writer.NumAcc) - 1)) | (uint8_t)Writer.Acc;
+}
+
+//Kernel pair for one combination of bits per channel and channels
+#define FORMAT_KERNELS(Bits, Channels)																	\
+static void format_embed_##Bits##_##Channels(uint8_t *Channel, size_t Count, unsigned Phase,			\
+											 const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)	\
+{																										\
+	format_embed(Channel, Count, Phase, Payload, FirstBit, NumBits, Bits, Channels);					\
+}																										\
+static void format_extract_##Bits##_##Channels(const uint8_t *Channel, size_t Count, unsigned Phase,	\
+											   uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)	\
+{																										\
+	format_extract(Channel, Count, Phase, Payload, FirstBit, NumBits, Bits, Channels);					\
+}
+
+#define FORMAT_KERNELS_ALL_CHANNELS(Bits)	\
+	FORMAT_KERNELS(Bits, 1)					\
+	FORMAT_KERNELS(Bits, 2)					\
+	FORMAT_KERNELS(Bits, 3)					\
+	FORMAT_KERNELS(Bits, 4)					\
+	FORMAT_KERNELS(Bits, 5)					\
+	FORMAT_KERNELS(Bits, 6)					\
+	FORMAT_KERNELS(Bits, 7)
+
+FORMAT_KERNELS_ALL_CHANNELS(1)
+FORMAT_KERNELS_ALL_CHANNELS(2)
+FORMAT_KERNELS_ALL_CHANNELS(3)
+FORMAT_KERNELS_ALL_CHANNELS(4)
+
+#define FORMAT_ENTRY(Bits, Channels)	{format_embed_##Bits##_##Channels, format_extract_##Bits##_##Channels}
+
+#define FORMAT_ROW(Bits)																	\
+	{FORMAT_ENTRY(Bits, 1), FORMAT_ENTRY(Bits, 2), FORMAT_ENTRY(Bits, 3), FORMAT_ENTRY(Bits, 4),	\
+	 FORMAT_ENTRY(Bits, 5), FORMAT_ENTRY(Bits, 6), FORMAT_ENTRY(Bits, 7)}
+
+//Kernels indexed by [Bits - 1][Channels - 1]
+static const struct
+{
+	void (*Embed)(uint8_t *, size_t, unsigned, const uint8_t *, uint64_t, uint64_t);
+	void (*Extract)(const uint8_t *, size_t, unsigned, uint8_t *, uint64_t, uint64_t);
+} FormatKernel[LSB_MAX_BITS][LSB_ALL_CHANNELS] =
+{
+	FORMAT_ROW(1), FORMAT_ROW(2), FORMAT_ROW(3), FORMAT_ROW(4)
+};
+
+//The default format goes to the vector kernels
+#define IS_DEFAULT_FORMAT(Format)	(((Format)->Bits == 1) && ((Format)->Channels == LSB_ALL_CHANNELS))
+
+
+/******************************************************************************/
+//Kernel variants, in increasing order of preference
+static const lsb_kernel_t KernelTable[] =
+{
+	{"scalar", cpu_has_nothing, lsb_embed_scalar, lsb_extract_scalar},
+#ifdef LSB_X86
+	{"sse2", cpu_has_sse2, lsb_embed_sse2, lsb_extract_sse2},
+	{"avx2", cpu_has_avx2, lsb_embed_avx2, lsb_extract_avx2},
+	{"avx512", cpu_has_avx512, lsb_embed_avx512, lsb_extract_avx512},
+#endif
+};
+
+#define NUM_KERNELS		(sizeof(KernelTable) / sizeof(KernelTable[0]))
+
+//Kernel in use. Scalar until lsb_select_kernel() is called
+static const lsb_kernel_t *Kernel = &KernelTable[0];
+
+//One bit in every channel
+static const lsb_format_t DefaultFormat = {1, LSB_ALL_CHANNELS};
+
+/******************************************************************************/
+//32 bpp pixels go through the channel kernels packed like 24 bpp pixels, at
+//most PACK_PIXELS at a time. Unpacking writes only the channels that changed.
+#define PACK_PIXELS		512
+
+static void pack_scalar(uint8_t *Packed, const uint8_t *Pixels, size_t NumPixels, const pixel_layout_t *Layout)
+{
+	for(size_t i = 0; i < NumPixels; i++)
+	{
+		Packed[3 * i] = Pixels[4 * i + Layout->Offset[0]];
+		Packed[3 * i + 1] = Pixels[4 * i + Layout->Offset[1]];
+		Packed[3 * i + 2] = Pixels[4 * i + Layout->Offset[2]];
+	}
+}
+
+static void unpack_scalar(uint8_t *Pixels, const uint8_t *Packed, size_t NumPixels, const pixel_layout_t *Layout)
+{
+	for(size_t i = 0; i < NumPixels; i++)
+	{
+		for(unsigned Channel = 0; Channel < 3; Channel++)
+		{
+			if(Pixels[4 * i + Layout->Offset[Channel]] != Packed[3 * i + Channel])
+				Pixels[4 * i + Layout->Offset[Channel]] = Packed[3 * i + Channel];
+		}
+	}
+}
+
+#ifdef LSB_X86
+/******************************************************************************/
+//SSSE3 variant: 4 pixels per shuffle, the masks built from the channel offsets.
+//Packed is written (and read) up to 4 bytes past the last pixel.
+__attribute__((target("ssse3")))
+static void pack_ssse3(uint8_t *Packed, const uint8_t *Pixels, size_t NumPixels, const pixel_layout_t *Layout)
+{
+	uint8_t		Mask[16];
+	__m128i		Shuffle;
+	size_t		i;
+	
+	for(unsigned k = 0; k < 16; k++)
+		Mask[k] = (k < 12) ? 4 * (k / 3) + Layout->Offset[k % 3] : 0x80;
+	Shuffle = _mm_loadu_si128((const __m128i *)Mask);
+	
+	for(i = 0; i + 4 <= NumPixels; i += 4)
+		_mm_storeu_si128((__m128i *)(Packed + 3 * i),
+						 _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Pixels + 4 * i)), Shuffle));
+	
+	pack_scalar(Packed + 3 * i, Pixels + 4 * i, NumPixels - i, Layout);
+}
+
+__attribute__((target("ssse3")))
+static void unpack_ssse3(uint8_t *Pixels, const uint8_t *Packed, size_t NumPixels, const pixel_layout_t *Layout)
+{
+	uint8_t		Mask[16];
+	__m128i		Shuffle;
+	__m128i		Keep;
+	__m128i		Value;
+	__m128i		NewValue;
+	size_t		i;
+	
+	//Bytes that are not channels (alpha) come out of the shuffle as 0xFF
+	memset(Mask, 0x80, sizeof(Mask));
+	for(unsigned k = 0; k < 12; k++)
+		Mask[4 * (k / 3) + Layout->Offset[k % 3]] = k;
+	Shuffle = _mm_loadu_si128((const __m128i *)Mask);
+	Keep = _mm_cmpeq_epi8(Shuffle, _mm_set1_epi8((char)0x80));
+	
+	//Blocks of 4 pixels that did not change are not written
+	for(i = 0; i + 4 <= NumPixels; i += 4)
+	{
+		Value = _mm_loadu_si128((const __m128i *)(Pixels + 4 * i));
+		NewValue = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Packed + 3 * i)), Shuffle);
+		NewValue = _mm_or_si128(NewValue, _mm_and_si128(Value, Keep));
+		
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(NewValue, Value)) != 0xFFFF)
+			_mm_storeu_si128((__m128i *)(Pixels + 4 * i), NewValue);
+	}
+	
+	unpack_scalar(Pixels + 4 * i, Packed + 3 * i, NumPixels - i, Layout);
+}
+#endif
+
+//Pack variants, in increasing order of preference
+static const struct
+{
+	const char *Name;
+	int (*Supported)(void);
+	void (*Pack)(uint8_t *, const uint8_t *, size_t, const pixel_layout_t *);
+	void (*Unpack)(uint8_t *, const uint8_t *, size_t, const pixel_layout_t *);
+} PackTable[] =
+{
+	{"scalar", cpu_has_nothing, pack_scalar, unpack_scalar},
+#ifdef LSB_X86
+	{"ssse3", cpu_has_ssse3, pack_ssse3, unpack_ssse3},
+#endif
+};
+
+#define NUM_PACKS		(sizeof(PackTable) / sizeof(PackTable[0]))
+
+//Pack variant in use, chosen with the kernel
+static size_t PackIndex = 0;
+
+/******************************************************************************/
+//Pack variant to go with the kernel: the best one, scalar for the scalar kernel
+static void select_pack(void)
+{
+	PackIndex = 0;
+	for(size_t i = 1; (i < NUM_PACKS) && (Kernel != &KernelTable[0]); i++)
+	{
+		if(PackTable[i].Supported())
+			PackIndex = i;
+	}
+}
+
+/******************************************************************************/
+//Copy channel slots [First, End) of a block of 32 bpp pixels to its packed
+//form, or back writing only the channels that changed. Used for the pixels at
+//the ends of a run that hold slots of the run and slots of another one.
+static void copy_slots(uint8_t *Packed, uint8_t *Pixels, size_t First, size_t End, const pixel_layout_t *Layout,
+					   uint8_t Unpack)
+{
+	uint8_t		*Channel;
+	
+	for(size_t Slot = First; Slot < End; Slot++)
+	{
+		Channel = Pixels + LSB_SLOT_BYTE(Layout, Slot);
+		if(!Unpack)
+			Packed[Slot] = *Channel;
+		else if(*Channel != Packed[Slot])
+			*Channel = Packed[Slot];
+	}
+}
+
+/******************************************************************************/
+//Store or recover payload bits in the channels of a run of 32 bpp pixels, a
+//block of pixels at a time. Only the slots holding the NumBits bits are read
+//or written, so runs of different threads may share a pixel.
+static void pixels_32bpp(uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count,
+						 unsigned Phase, const lsb_format_t *Format, uint8_t *Payload, uint64_t FirstBit,
+						 uint64_t NumBits, size_t Pack, uint8_t Embed)
+{
+	uint8_t		Packed[3 * PACK_PIXELS + 16] = {0};
+	uint64_t	Pixel = Column / 3;
+	unsigned	Lead = Column % 3;
+	size_t		NumPixels;
+	size_t		Slots;
+	size_t		FirstWhole;
+	size_t		EndWhole;
+	size_t		HeadEnd;
+	size_t		TailStart;
+	uint64_t	Bits;
+	
+	if(Count > lsb_format_slots(Format, Phase, NumBits))
+		Count = lsb_format_slots(Format, Phase, NumBits);
+	
+	while(Count > 0)
+	{
+		NumPixels = (Lead + Count + 2) / 3;
+		if(NumPixels > PACK_PIXELS)
+			NumPixels = PACK_PIXELS;
+		Slots = (3 * NumPixels - Lead < Count) ? 3 * NumPixels - Lead : Count;
+		
+		Bits = lsb_format_bits(Format, Phase, Slots);
+		if(Bits > NumBits)
+			Bits = NumBits;
+		
+		//Pixels wholly inside the run go through the pack variant, the slots
+		//of the pixels at its ends one by one
+		FirstWhole = (Lead > 0) ? 1 : 0;
+		EndWhole = (Lead + Slots) / 3;
+		if(EndWhole < FirstWhole)
+			EndWhole = FirstWhole;
+		HeadEnd = (3 * FirstWhole < Lead + Slots) ? 3 * FirstWhole : Lead + Slots;
+		TailStart = (3 * EndWhole > HeadEnd) ? 3 * EndWhole : HeadEnd;
+		
+		//Pack variants may write past the last whole pixel, so the tail is
+		//copied after them
+		PackTable[Pack].Pack(Packed + 3 * FirstWhole, Pixels + 4 * (Pixel + FirstWhole), EndWhole - FirstWhole,
+							 Layout);
+		copy_slots(Packed, Pixels + 4 * Pixel, Lead, HeadEnd, Layout, 0);
+		copy_slots(Packed, Pixels + 4 * Pixel, TailStart, Lead + Slots, Layout, 0);
+		
+		if(Embed)
+		{
+			lsb_embed_format(Packed + Lead, Slots, Phase, Format, Payload, FirstBit, Bits);
+			PackTable[Pack].Unpack(Pixels + 4 * (Pixel + FirstWhole), Packed + 3 * FirstWhole,
+								   EndWhole - FirstWhole, Layout);
+			copy_slots(Packed, Pixels + 4 * Pixel, Lead, HeadEnd, Layout, 1);
+			copy_slots(Packed, Pixels + 4 * Pixel, TailStart, Lead + Slots, Layout, 1);
+		}
+		else
+		{
+			lsb_extract_format(Packed + Lead, Slots, Phase, Format, Payload, FirstBit, Bits);
+		}
+		
+		FirstBit += Bits;
+		NumBits -= Bits;
+		Count -= Slots;
+		Phase = (Phase + Slots) % 3;
+		Pixel += NumPixels;
+		Lead = 0;
+	}
+}
+
+/******************************************************************************/
+//Store payload bits in the palette indexes of a run of 8 bpp pixels, a block
+//at a time. Bits are set in a copy of the indexes, then every index whose bit
+//changed is replaced by the nearest color with the other bit (1 bit formats
+//only). Only the indexes holding the NumBits bits are read or written.
+static void palette_embed(uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count,
+						  unsigned Phase, const lsb_format_t *Format, const uint8_t *Payload, uint64_t FirstBit,
+						  uint64_t NumBits)
+{
+	uint8_t		Indexes[3 * PACK_PIXELS];
+	uint8_t		*Index = Pixels + Column;
+	size_t		Slots;
+	uint64_t	Bits;
+	
+	if(Count > lsb_format_slots(Format, Phase, NumBits))
+		Count = lsb_format_slots(Format, Phase, NumBits);
+	
+	while(Count > 0)
+	{
+		Slots = (Count < sizeof(Indexes)) ? Count : sizeof(Indexes);
+		Bits = lsb_format_bits(Format, Phase, Slots);
+		if(Bits > NumBits)
+			Bits = NumBits;
+		
+		memcpy(Indexes, Index, Slots);
+		lsb_embed_format(Indexes, Slots, Phase, Format, Payload, FirstBit, Bits);
+		for(size_t i = 0; i < Slots; i++)
+		{
+			if(Indexes[i] != Index[i])
+				Index[i] = Layout->Nearest[Index[i]];
+		}
+		
+		FirstBit += Bits;
+		NumBits -= Bits;
+		Count -= Slots;
+		Phase = (Phase + Slots) % 3;
+		Index += Slots;
+	}
+}
+
+/******************************************************************************/
+//Small xorshift generator for the self test (reproducible on every machine)
+static uint64_t self_test_random(uint64_t *State)
+{
+	*State ^= *State << 13;
+	*State ^= *State >> 7;
+	*State ^= *State << 17;
+	return *State;
+}
+
+/******************************************************************************/
+//Monotonic wall clock in seconds, for the kernel benchmark
+static double bench_seconds(void)
+{
+	struct timespec	Now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return Now.tv_sec + Now.tv_nsec * 1e-9;
+}
+
+
+/******************************************************************************/
+//Store or recover payload bits with a density format, row by row
+static void format_rows(img24_t *Img, const lsb_format_t *Format, uint8_t *Payload,
+						uint64_t FirstSlot, uint64_t NumBits, uint8_t Embed)
+{
+	uint64_t	RowSlots = LSB_ROW_SLOTS(Img);
+	int32_t		Row = FirstSlot / RowSlots;
+	uint64_t	Column = FirstSlot % RowSlots;
+	uint64_t	Done = 0;
+	uint64_t	Count;
+	
+	while((Done < NumBits) && (Row < Img->Height))
+	{
+		Count = lsb_format_bits(Format, (uint64_t)Row * RowSlots + Column, RowSlots - Column);
+		if(Count > NumBits - Done)
+			Count = NumBits - Done;
+		
+		//The slot gives the channel (rows of 8 bpp images may not hold whole
+		//pixels)
+		if(Embed)
+			lsb_embed_row((uint8_t *)Img->Pixel[Row], &Img->Layout, Column, RowSlots - Column,
+						  ((uint64_t)Row * RowSlots + Column) % 3, Format, Payload, Done, Count);
+		else
+			lsb_extract_row((const uint8_t *)Img->Pixel[Row], &Img->Layout, Column, RowSlots - Column,
+							((uint64_t)Row * RowSlots + Column) % 3, Format, Payload, Done, Count);
+		
+		Done += Count;
+		Column = 0;
+		Row++;
+	}
+}
+
+/******************************************************************************/
+//Bit by bit reference of the density format kernels for the self test
+static void format_embed_reference(uint8_t *Channel, size_t Count, unsigned Phase, const lsb_format_t *Format,
+								   const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	uint64_t	Bit = FirstBit;
+	
+	for(size_t i = 0; (i < Count) && (Bit < FirstBit + NumBits); i++)
+	{
+		if(!(Format->Channels & (1 << ((Phase + i) % 3))))
+			continue;
+		
+		for(unsigned j = 0; (j < Format->Bits) && (Bit < FirstBit + NumBits); j++, Bit++)
+			Channel[i] = (Channel[i] & ~(1 << j)) | (((Payload[Bit >> 3] >> (Bit & 7)) & 1) << j);
+	}
+}
+
+/******************************************************************************/
+//Slot by slot reference of the 32 bpp pixel kernels for the self test
+static void pixels_embed_reference(uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count,
+								   const lsb_format_t *Format, const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	uint64_t	Bit = FirstBit;
+	uint8_t		*Channel;
+	
+	for(uint64_t Slot = Column; (Slot < Column + Count) && (Bit < FirstBit + NumBits); Slot++)
+	{
+		if(!(Format->Channels & (1 << (Slot % 3))))
+			continue;
+		
+		Channel = Pixels + LSB_SLOT_BYTE(Layout, Slot);
+		for(unsigned j = 0; (j < Format->Bits) && (Bit < FirstBit + NumBits); j++, Bit++)
+			*Channel = (*Channel & ~(1 << j)) | (((Payload[Bit >> 3] >> (Bit & 7)) & 1) << j);
+	}
+}
+
+/******************************************************************************/
+//Work of one row band for the multithreaded image functions
+struct lsb_band
+{
+	img24_t *Img;
+	const lsb_format_t *Format;
+	uint8_t *Payload;					//Payload bytes of this band (starts byte aligned)
+	uint64_t FirstSlot;
+	uint64_t NumBits;
+	uint8_t Embed;						//1: embed, 0: extract
+};
+
+static void *run_band(void *Arg)
+{
+	struct lsb_band *Band = Arg;
+	
+	format_rows(Band->Img, Band->Format, Band->Payload, Band->FirstSlot, Band->NumBits, Band->Embed);
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Split the slots into row bands and process them on NumThreads threads. Band
+//boundaries fall on payload byte boundaries (every 8 channel fields) so no two
+//threads ever write to the same payload byte, and each band knows its payload
+//bit offset up front.
+static void run_bands(img24_t *Img, const lsb_format_t *Format, uint8_t *Payload, uint64_t FirstSlot,
+					  uint64_t NumBits, int NumThreads, uint8_t Embed)
+{
+	uint64_t		RowSlots = LSB_ROW_SLOTS(Img);
+	uint64_t		FirstRow;
+	uint64_t		NumRows;
+	uint64_t		BandStart;
+	uint64_t		BandEnd;
+	uint64_t		Boundary;
+	
+	struct lsb_band	*Band;
+	pthread_t		*Thread;
+	uint8_t			*Started;
+	
+	if(NumBits == 0)
+		return;
+	
+	FirstRow = FirstSlot / RowSlots;
+	NumRows = (FirstSlot + lsb_format_slots(Format, FirstSlot, NumBits) - 1) / RowSlots - FirstRow + 1;
+	
+	//Not worth a thread per band for small payloads
+	if(NumThreads > (int64_t)NumRows)
+		NumThreads = NumRows;
+	if(NumBits < LSB_MIN_BITS_PER_THREAD * (uint64_t)NumThreads)
+		NumThreads = 1 + NumBits / LSB_MIN_BITS_PER_THREAD;
+	
+	Band = malloc(NumThreads * sizeof(struct lsb_band));
+	Thread = malloc(NumThreads * sizeof(pthread_t));
+	Started = calloc(NumThreads, 1);
+	if((Band == NULL) || (Thread == NULL) || (Started == NULL))
+	{
+		printf("Error: could not allocate memory for worker threads\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	BandStart = 0;
+	for(int i = 0; i < NumThreads; i++)
+	{
+		//Band ends at the first slot of a row, moved back to a payload byte boundary
+		if(i == NumThreads - 1)
+		{
+			BandEnd = NumBits;
+		}
+		else
+		{
+			Boundary = (FirstRow + NumRows * (i + 1) / NumThreads) * RowSlots;
+			BandEnd = (Boundary > FirstSlot) ? lsb_format_bits(Format, FirstSlot, Boundary - FirstSlot) : 0;
+			BandEnd = (BandEnd / Format->Bits) & ~((uint64_t)7);
+			BandEnd *= Format->Bits;
+			if(BandEnd > NumBits)
+				BandEnd = NumBits;
+			if(BandEnd < BandStart)
+				BandEnd = BandStart;
+		}
+		
+		Band[i].Img = Img;
+		Band[i].Format = Format;
+		Band[i].Payload = Payload + (BandStart >> 3);
+		Band[i].FirstSlot = FirstSlot + lsb_format_slots(Format, FirstSlot, BandStart);
+		Band[i].NumBits = BandEnd - BandStart;
+		Band[i].Embed = Embed;
+		BandStart = BandEnd;
+		
+		//Last band runs on the calling thread, as does any band whose thread
+		//could not be created
+		if((i < NumThreads - 1) && (Band[i].NumBits > 0))
+			Started[i] = (pthread_create(&Thread[i], NULL, run_band, &Band[i]) == 0);
+		
+		if(!Started[i])
+			run_band(&Band[i]);
+	}
+	
+	for(int i = 0; i < NumThreads; i++)
+	{
+		if(Started[i])
+			pthread_join(Thread[i], NULL);
+	}
+	
+	free(Band);
+	free(Thread);
+	free(Started);
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Select kernel variant by name, or the best one supported by the CPU if Name
+//is NULL or "auto". Returns -1 if the variant is unknown or not supported.
+int lsb_select_kernel(const char *Name)
+{
+	if((Name == NULL) || (strcmp(Name, "auto") == 0))
+	{
+		for(size_t i = 0; i < NUM_KERNELS; i++)
+		{
+			if(KernelTable[i].Supported())
+				Kernel = &KernelTable[i];
+		}
+		select_pack();
+		return 0;
+	}
+	
+	for(size_t i = 0; i < NUM_KERNELS; i++)
+	{
+		if(strcmp(Name, KernelTable[i].Name) == 0)
+		{
+			if(!KernelTable[i].Supported())
+				return -1;
+			
+			Kernel = &KernelTable[i];
+			select_pack();
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+/******************************************************************************/
+//Name of the kernel variant in use
+const char *lsb_kernel_name(void)
+{
+	return Kernel->Name;
+}
+
+/******************************************************************************/
+//Cross check every supported variant against the scalar kernel, bit exact.
+//Returns the number of variants that failed.
+int lsb_self_test(void)
+{
+	const size_t	BufferSize = 4096;
+	const int		NumCases = 2000;
+	
+	uint8_t			*Payload = malloc(BufferSize);
+	uint8_t			*Reference = malloc(BufferSize);
+	uint8_t			*Result = malloc(BufferSize);
+	uint8_t			*Original = malloc(BufferSize);
+	uint64_t		State;
+	uint64_t		FirstBit;
+	size_t			Count;
+	int				Failures = 0;
+	int				Mismatch;
+	
+	if((Payload == NULL) || (Reference == NULL) || (Result == NULL) || (Original == NULL))
+	{
+		printf("Error: could not allocate memory for kernel self test\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(size_t k = 0; k < NUM_KERNELS; k++)
+	{
+		printf("Kernel %-8s ... ", KernelTable[k].Name);
+		if(!KernelTable[k].Supported())
+		{
+			printf("not supported by this CPU\n");
+			continue;
+		}
+		
+		//Random channel runs (crossing every head/body/tail split) at random
+		//payload bit offsets, for both embedding and extraction
+		State = 0x9E3779B97F4A7C15;
+		Mismatch = 0;
+		for(int test = 0; (test < NumCases) && !Mismatch; test++)
+		{
+			for(size_t i = 0; i < BufferSize; i++)
+			{
+				Original[i] = self_test_random(&State);
+				Payload[i] = self_test_random(&State);
+			}
+			FirstBit = self_test_random(&State) % 1024;
+			Count = self_test_random(&State) % (BufferSize - 128);
+			
+			memcpy(Reference, Original, BufferSize);
+			memcpy(Result, Original, BufferSize);
+			lsb_embed_scalar(Reference, Count, Payload, FirstBit);
+			KernelTable[k].Embed(Result, Count, Payload, FirstBit);
+			Mismatch |= memcmp(Reference, Result, BufferSize);
+			
+			memcpy(Reference, Payload, BufferSize);
+			memcpy(Result, Payload, BufferSize);
+			lsb_extract_scalar(Original, Count, Reference, FirstBit);
+			KernelTable[k].Extract(Original, Count, Result, FirstBit);
+			Mismatch |= memcmp(Reference, Result, BufferSize);
+		}
+		
+		if(Mismatch)
+		{
+			printf("FAILED\n");
+			Failures++;
+		}
+		else
+		{
+			printf("OK\n");
+		}
+	}
+	
+	//Density format kernels against the bit by bit reference, extraction
+	//checked by round trip (bits outside the payload range must be kept)
+	printf("Density formats ... ");
+	State = 0x9E3779B97F4A7C15;
+	Mismatch = 0;
+	for(int test = 0; (test < NumCases) && !Mismatch; test++)
+	{
+		lsb_format_t	Format = {1 + test % LSB_MAX_BITS, 1 + (test / LSB_MAX_BITS) % LSB_ALL_CHANNELS};
+		unsigned		Phase = self_test_random(&State) % 3;
+		uint64_t		NumBits;
+		
+		for(size_t i = 0; i < BufferSize; i++)
+		{
+			Original[i] = self_test_random(&State);
+			Payload[i] = self_test_random(&State);
+		}
+		FirstBit = self_test_random(&State) % 1024;
+		Count = self_test_random(&State) % (BufferSize / 4);
+		NumBits = lsb_format_bits(&Format, Phase, Count);
+		if(test & 1)
+			NumBits = (NumBits > 0) ? self_test_random(&State) % NumBits : 0;
+		
+		memcpy(Reference, Original, BufferSize);
+		memcpy(Result, Original, BufferSize);
+		format_embed_reference(Reference, Count, Phase, &Format, Payload, FirstBit, NumBits);
+		lsb_embed_format(Result, Count, Phase, &Format, Payload, FirstBit, NumBits);
+		Mismatch |= memcmp(Reference, Result, BufferSize);
+		
+		memcpy(Reference, Original, BufferSize);
+		for(uint64_t Bit = FirstBit; Bit < FirstBit + NumBits; Bit++)
+			Reference[Bit >> 3] = (Reference[Bit >> 3] & ~(1 << (Bit & 7))) | (Payload[Bit >> 3] & (1 << (Bit & 7)));
+		
+		memcpy(Original, Result, BufferSize);
+		memcpy(Result, Reference, BufferSize);
+		for(uint64_t Bit = FirstBit; Bit < FirstBit + NumBits; Bit++)
+			Result[Bit >> 3] ^= 1 << (Bit & 7);
+		lsb_extract_format(Original, Count, Phase, &Format, Result, FirstBit, NumBits);
+		Mismatch |= memcmp(Reference, Result, BufferSize);
+	}
+	
+	if(Mismatch)
+	{
+		printf("FAILED\n");
+		Failures++;
+	}
+	else
+	{
+		printf("OK\n");
+	}
+	
+	//32 bpp pixels with every order of the channel bytes, against the slot by
+	//slot reference, extraction checked by round trip as above
+	for(size_t k = 0; k < NUM_PACKS; k++)
+	{
+		printf("32 bpp %-8s ... ", PackTable[k].Name);
+		if(!PackTable[k].Supported())
+		{
+			printf("not supported by this CPU\n");
+			continue;
+		}
+		
+		State = 0x9E3779B97F4A7C15;
+		Mismatch = 0;
+		for(int test = 0; (test < NumCases) && !Mismatch; test++)
+		{
+			lsb_format_t	Format = {1 + test % LSB_MAX_BITS, 1 + (test / LSB_MAX_BITS) % LSB_ALL_CHANNELS};
+			pixel_layout_t	Layout = {4, 3, {0}};
+			uint8_t			Order[4] = {0, 1, 2, 3};
+			uint64_t		Column = self_test_random(&State) % 8;
+			uint64_t		NumBits;
+			unsigned		Swap;
+			
+			//Random order of the bytes of a pixel, the last one is alpha
+			for(unsigned k = 3; k > 0; k--)
+			{
+				Swap = self_test_random(&State) % (k + 1);
+				Layout.Offset[0] = Order[k];
+				Order[k] = Order[Swap];
+				Order[Swap] = Layout.Offset[0];
+			}
+			memcpy(Layout.Offset, Order, 3);
+			
+			for(size_t i = 0; i < BufferSize; i++)
+			{
+				Original[i] = self_test_random(&State);
+				Payload[i] = self_test_random(&State);
+			}
+			FirstBit = self_test_random(&State) % 1024;
+			Count = self_test_random(&State) % (BufferSize / 4 * 3 - Column);
+			NumBits = lsb_format_bits(&Format, Column, Count);
+			if(test & 1)
+				NumBits = (NumBits > 0) ? self_test_random(&State) % NumBits : 0;
+			
+			memcpy(Reference, Original, BufferSize);
+			memcpy(Result, Original, BufferSize);
+			pixels_embed_reference(Reference, &Layout, Column, Count, &Format, Payload, FirstBit, NumBits);
+			pixels_32bpp(Result, &Layout, Column, Count, Column % 3, &Format, Payload, FirstBit, NumBits, k, 1);
+			Mismatch |= memcmp(Reference, Result, BufferSize);
+			
+			memcpy(Original, Result, BufferSize);
+			memcpy(Reference, Payload, BufferSize);
+			memcpy(Result, Payload, BufferSize);
+			for(uint64_t Bit = FirstBit; Bit < FirstBit + NumBits; Bit++)
+				Result[Bit >> 3] ^= 1 << (Bit & 7);
+			pixels_32bpp(Original, &Layout, Column, Count, Column % 3, &Format, Result, FirstBit, NumBits, k, 0);
+			Mismatch |= memcmp(Reference, Result, BufferSize);
+		}
+		
+		if(Mismatch)
+		{
+			printf("FAILED\n");
+			Failures++;
+		}
+		else
+		{
+			printf("OK\n");
+		}
+	}
+	
+	//Palette indexes against the same rule index by index, extraction by round
+	//trip
+	printf("8 bpp palette   ... ");
+	State = 0x9E3779B97F4A7C15;
+	Mismatch = 0;
+	for(int test = 0; (test < NumCases) && !Mismatch; test++)
+	{
+		pixel_layout_t	Layout = {1, 1, {0}};
+		uint64_t		Column = self_test_random(&State) % 8;
+		uint64_t		NumBits;
+		uint64_t		Bit;
+		
+		for(unsigned i = 0; i < 256; i++)
+			Layout.Nearest[i] = (self_test_random(&State) & ~1u) | (~i & 1);
+		for(size_t i = 0; i < BufferSize; i++)
+		{
+			Original[i] = self_test_random(&State);
+			Payload[i] = self_test_random(&State);
+		}
+		FirstBit = self_test_random(&State) % 1024;
+		Count = self_test_random(&State) % (BufferSize - Column);
+		NumBits = (test & 1) ? self_test_random(&State) % (Count + 1) : Count;
+		
+		memcpy(Reference, Original, BufferSize);
+		memcpy(Result, Original, BufferSize);
+		Bit = FirstBit;
+		for(uint64_t Slot = Column; Slot < Column + NumBits; Slot++, Bit++)
+		{
+			if((Reference[Slot] & 1) != ((Payload[Bit >> 3] >> (Bit & 7)) & 1))
+				Reference[Slot] = Layout.Nearest[Reference[Slot]];
+		}
+		lsb_embed_row(Result, &Layout, Column, Count, Column % 3, &DefaultFormat, Payload, FirstBit, NumBits);
+		Mismatch |= memcmp(Reference, Result, BufferSize);
+		
+		memcpy(Reference, Payload, BufferSize);
+		for(uint64_t i = FirstBit; i < FirstBit + NumBits; i++)
+			Payload[i >> 3] ^= 1 << (i & 7);
+		lsb_extract_row(Result, &Layout, Column, Count, Column % 3, &DefaultFormat, Payload, FirstBit, NumBits);
+		Mismatch |= memcmp(Reference, Payload, BufferSize);
+	}
+	
+	if(Mismatch)
+	{
+		printf("FAILED\n");
+		Failures++;
+	}
+	else
+	{
+		printf("OK\n");
+	}
+	
+	free(Payload);
+	free(Reference);
+	free(Result);
+	free(Original);
+	
+	return Failures;
+}
+
+/******************************************************************************/
+//Time every supported kernel variant over a large channel buffer
+void lsb_bench(void)
+{
+	const size_t	BufferSize = (size_t)1 << 26;
+	const int		NumRounds = 16;
+	
+	uint8_t			*Channel = malloc(BufferSize);
+	uint8_t			*Payload = malloc(BufferSize / 8);
+	uint64_t		State = 0x9E3779B97F4A7C15;
+	double			Start;
+	double			Embed;
+	double			Extract;
+	
+	if((Channel == NULL) || (Payload == NULL))
+	{
+		printf("Error: could not allocate memory for kernel benchmark\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(size_t i = 0; i < BufferSize; i++)
+		Channel[i] = self_test_random(&State);
+	for(size_t i = 0; i < BufferSize / 8; i++)
+		Payload[i] = self_test_random(&State);
+	
+	//Throughput in channel bytes per second, single thread, buffer already
+	//paged in, payload bit offset not byte aligned so heads and tails run too
+	printf("%zu MiB of channels, %d rounds per kernel\n", BufferSize >> 20, NumRounds);
+	for(size_t k = 0; k < NUM_KERNELS; k++)
+	{
+		printf("Kernel %-8s ... ", KernelTable[k].Name);
+		if(!KernelTable[k].Supported())
+		{
+			printf("not supported by this CPU\n");
+			continue;
+		}
+		
+		KernelTable[k].Embed(Channel, BufferSize - 8, Payload, 3);
+		Start = bench_seconds();
+		for(int r = 0; r < NumRounds; r++)
+			KernelTable[k].Embed(Channel, BufferSize - 8, Payload, 3);
+		Embed = bench_seconds() - Start;
+		
+		KernelTable[k].Extract(Channel, BufferSize - 8, Payload, 3);
+		Start = bench_seconds();
+		for(int r = 0; r < NumRounds; r++)
+			KernelTable[k].Extract(Channel, BufferSize - 8, Payload, 3);
+		Extract = bench_seconds() - Start;
+		
+		printf("embed %6.2f GB/s, extract %6.2f GB/s\n", (double)BufferSize * NumRounds / Embed * 1e-9,
+			   (double)BufferSize * NumRounds / Extract * 1e-9);
+	}
+	
+	free(Channel);
+	free(Payload);
+}
+
+/******************************************************************************/
+//Store payload bits in the LSB of channels
+void lsb_embed(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit)
+{
+	Kernel->Embed(Channel, Count, Payload, FirstBit);
+}
+
+/******************************************************************************/
+//Recover payload bits from the LSB of channels
+void lsb_extract(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit)
+{
+	Kernel->Extract(Channel, Count, Payload, FirstBit);
+}
+
+/******************************************************************************/
+//Store payload bits in the channels selected by the format
+void lsb_embed_format(uint8_t *Channel, size_t Count, unsigned Phase, const lsb_format_t *Format,
+					  const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	if(IS_DEFAULT_FORMAT(Format))
+		lsb_embed(Channel, (NumBits < Count) ? NumBits : Count, Payload, FirstBit);
+	else
+		FormatKernel[Format->Bits - 1][Format->Channels - 1].Embed(Channel, Count, Phase, Payload, FirstBit, NumBits);
+}
+
+/******************************************************************************/
+//Recover payload bits from the channels selected by the format
+void lsb_extract_format(const uint8_t *Channel, size_t Count, unsigned Phase, const lsb_format_t *Format,
+						uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	if(IS_DEFAULT_FORMAT(Format))
+		lsb_extract(Channel, (NumBits < Count) ? NumBits : Count, Payload, FirstBit);
+	else
+		FormatKernel[Format->Bits - 1][Format->Channels - 1].Extract(Channel, Count, Phase, Payload, FirstBit, NumBits);
+}
+
+/******************************************************************************/
+//Store payload bits in the channel slots of a run of pixels
+void lsb_embed_row(uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count, unsigned Phase,
+				   const lsb_format_t *Format, const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	//Channel bytes of 24 bpp pixels are contiguous
+	if(Layout->BytesPerPixel == 3)
+		lsb_embed_format(Pixels + Column, Count, Phase, Format, Payload, FirstBit, NumBits);
+	else if(Layout->BytesPerPixel == 1)
+		palette_embed(Pixels, Layout, Column, Count, Phase, Format, Payload, FirstBit, NumBits);
+	else
+		pixels_32bpp(Pixels, Layout, Column, Count, Phase, Format, (uint8_t *)Payload, FirstBit, NumBits, PackIndex, 1);
+}
+
+/******************************************************************************/
+//Recover payload bits from the channel slots of a run of pixels
+void lsb_extract_row(const uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count,
+					 unsigned Phase, const lsb_format_t *Format, uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits)
+{
+	//Pixels are only read when extracting
+	if(Layout->BytesPerPixel == Layout->SlotsPerPixel)
+		lsb_extract_format(Pixels + Column, Count, Phase, Format, Payload, FirstBit, NumBits);
+	else
+		pixels_32bpp((uint8_t *)Pixels, Layout, Column, Count, Phase, Format, Payload, FirstBit, NumBits, PackIndex, 0);
+}
+
+/******************************************************************************/
+//Payload bits held by a run of channel slots
+uint64_t lsb_format_bits(const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumSlots)
+{
+	uint64_t	Fields = (NumSlots / 3) * __builtin_popcount(Format->Channels);
+	
+	//Whole pixels first, then the channels left at the end
+	for(uint64_t Slot = FirstSlot + NumSlots / 3 * 3; Slot < FirstSlot + NumSlots; Slot++)
+	{
+		if(Format->Channels & (1 << (Slot % 3)))
+			Fields++;
+	}
+	
+	return Fields * Format->Bits;
+}
+
+/******************************************************************************/
+//Channel slots needed to hold a number of payload bits
+uint64_t lsb_format_slots(const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumBits)
+{
+	uint64_t	Fields = (NumBits + Format->Bits - 1) / Format->Bits;
+	uint64_t	PixelFields = __builtin_popcount(Format->Channels);
+	uint64_t	Pixels;
+	uint64_t	Slot;
+	
+	if(Fields == 0)
+		return 0;
+	
+	//Whole pixels, then slot by slot up to the last field used
+	Pixels = (Fields - 1) / PixelFields;
+	Fields -= Pixels * PixelFields;
+	
+	for(Slot = FirstSlot + Pixels * 3; Fields > 0; Slot++)
+	{
+		if(Format->Channels & (1 << (Slot % 3)))
+			Fields--;
+	}
+	
+	return Slot - FirstSlot;
+}
+
+/******************************************************************************/
+//Non zero if the format is valid
+int lsb_format_valid(const lsb_format_t *Format)
+{
+	return (Format->Bits >= 1) && (Format->Bits <= LSB_MAX_BITS) &&
+		   (Format->Channels >= 1) && (Format->Channels <= LSB_ALL_CHANNELS);
+}
+
+/******************************************************************************/
+//Non zero if payload bits can be stored with the format in pixels of the layout
+int lsb_format_fits_layout(const lsb_format_t *Format, const pixel_layout_t *Layout)
+{
+	if(Layout->BytesPerPixel == 1)
+		return (Format->Bits == DefaultFormat.Bits) && (Format->Channels == DefaultFormat.Channels);
+	
+	return 1;
+}
+
+/******************************************************************************/
+//Store payload bits in the image, row by row
+void lsb_embed_img(img24_t *Img, const uint8_t *Payload, uint64_t FirstSlot, uint64_t NumBits)
+{
+	uint64_t	RowSlots = LSB_ROW_SLOTS(Img);
+	int32_t		Row = FirstSlot / RowSlots;
+	uint64_t	Column = FirstSlot % RowSlots;
+	uint64_t	Done = 0;
+	uint64_t	Count;
+	
+	while((Done < NumBits) && (Row < Img->Height))
+	{
+		Count = RowSlots - Column;
+		if(Count > NumBits - Done)
+			Count = NumBits - Done;
+		
+		lsb_embed_row((uint8_t *)Img->Pixel[Row], &Img->Layout, Column, Count, ((uint64_t)Row * RowSlots + Column) % 3,
+					  &DefaultFormat, Payload, Done, Count);
+		
+		Done += Count;
+		Column = 0;
+		Row++;
+	}
+}
+
+/******************************************************************************/
+//Recover payload bits from the image, row by row
+void lsb_extract_img(const img24_t *Img, uint8_t *Payload, uint64_t FirstSlot, uint64_t NumBits)
+{
+	uint64_t	RowSlots = LSB_ROW_SLOTS(Img);
+	int32_t		Row = FirstSlot / RowSlots;
+	uint64_t	Column = FirstSlot % RowSlots;
+	uint64_t	Done = 0;
+	uint64_t	Count;
+	
+	while((Done < NumBits) && (Row < Img->Height))
+	{
+		Count = RowSlots - Column;
+		if(Count > NumBits - Done)
+			Count = NumBits - Done;
+		
+		lsb_extract_row((const uint8_t *)Img->Pixel[Row], &Img->Layout, Column, Count,
+						((uint64_t)Row * RowSlots + Column) % 3, &DefaultFormat, Payload, Done, Count);
+		
+		Done += Count;
+		Column = 0;
+		Row++;
+	}
+}
+
+/******************************************************************************/
+//Store payload bits in the image with a density format
+void lsb_embed_img_format(img24_t *Img, const lsb_format_t *Format, const uint8_t *Payload,
+						  uint64_t FirstSlot, uint64_t NumBits, int NumThreads)
+{
+	//Payload is only read when embedding
+	run_bands(Img, Format, (uint8_t *)Payload, FirstSlot, NumBits, NumThreads, 1);
+}
+
+/******************************************************************************/
+//Recover payload bits from the image with a density format
+void lsb_extract_img_format(const img24_t *Img, const lsb_format_t *Format, uint8_t *Payload,
+							uint64_t FirstSlot, uint64_t NumBits, int NumThreads)
+{
+	//Image is only read when extracting
+	run_bands((img24_t *)Img, Format, Payload, FirstSlot, NumBits, NumThreads, 0);
+}
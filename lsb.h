@@ -0,0 +1,169 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the library that hides bits in the least           *
+ * significant bit (LSB) of pixel channels                           *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __LSB_H__
+#define __LSB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bitmap.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Payload bits are stored one per channel byte, in the order the channels appear
+//in the pixel matrix (Blue, Green, Red, next pixel ...), bottom row first.
+//Bit 0 (LSB) of each payload byte comes first. Each channel byte is a slot: 32
+//bpp pixels have 3 (alpha is skipped), 8 bpp pixels 1, their palette index.
+
+//Number of channel slots (one payload bit each) in one image row
+#define LSB_ROW_SLOTS(Img)	((uint64_t)(Img)->Width * (Img)->Layout.SlotsPerPixel)
+
+//Number of channel slots (one payload bit each) in the whole image
+#define LSB_IMG_SLOTS(Img)	(LSB_ROW_SLOTS(Img) * (uint64_t)(Img)->Height)
+
+//Byte of channel slot Column of a pixel row
+#define LSB_SLOT_BYTE(Layout, Column)	(((Layout)->BytesPerPixel == (Layout)->SlotsPerPixel) ? (Column) :	\
+										 (Column) / 3 * (Layout)->BytesPerPixel + (Layout)->Offset[(Column) % 3])
+
+//Smallest number of payload bits worth a worker thread in the *_mt functions
+#define LSB_MIN_BITS_PER_THREAD	(1 << 20)
+
+//Channels of a pixel, as used in lsb_format_t.Channels (slot index % 3)
+#define LSB_BLUE			0x1
+#define LSB_GREEN			0x2
+#define LSB_RED				0x4
+#define LSB_ALL_CHANNELS	(LSB_BLUE | LSB_GREEN | LSB_RED)
+
+//Highest number of payload bits stored per channel
+#define LSB_MAX_BITS		4
+
+//With a density format the payload bits fill the Bits lowest bits of every
+//channel selected by Channels, skipping the others. Channels are still
+//addressed by slot (one slot per channel byte), the channel of a slot being
+//slot % 3. The default format (1 bit, all channels) uses exactly one slot per
+//payload bit, and is the only one palette indexes take.
+
+/*******************************************************************************
+ *                                   STRUCTURES                                *
+ *******************************************************************************/
+
+//One variant (scalar, SSE2, AVX2 ...) of the channel kernels
+struct lsb_kernel
+{
+	const char *Name;
+	int (*Supported)(void);				//Non zero if the CPU can run this variant
+	void (*Embed)(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit);
+	void (*Extract)(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit);
+};
+
+//Embedding density
+struct lsb_format
+{
+	uint8_t Bits;						//Payload bits per channel (1 to LSB_MAX_BITS)
+	uint8_t Channels;					//Channels carrying payload (LSB_BLUE | ...)
+};
+
+typedef struct lsb_kernel			lsb_kernel_t;
+typedef struct lsb_format			lsb_format_t;
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//============================== KERNEL DISPATCH ===============================
+
+//------------------------------------------------------------------------------
+//Select kernel variant by name ("scalar", "sse2", "avx2", "avx512"), or the
+//best one the CPU supports if Name is NULL or "auto". Returns -1 on failure.
+int lsb_select_kernel(const char *Name);
+//------------------------------------------------------------------------------
+//Name of the kernel variant in use
+const char *lsb_kernel_name(void);
+//------------------------------------------------------------------------------
+//Check every supported variant bit exactly against the scalar kernel. Returns
+//the number of variants that failed.
+int lsb_self_test(void);
+//------------------------------------------------------------------------------
+//Print the single thread throughput of every supported variant
+void lsb_bench(void);
+
+//=============================== CHANNEL KERNELS ==============================
+
+//------------------------------------------------------------------------------
+//Store payload bits [FirstBit, FirstBit + Count) in the LSB of Count channels.
+//Only channels whose value actually changes are written.
+void lsb_embed(uint8_t *Channel, size_t Count, const uint8_t *Payload, uint64_t FirstBit);
+//------------------------------------------------------------------------------
+//Recover payload bits [FirstBit, FirstBit + Count) from the LSB of Count channels
+void lsb_extract(const uint8_t *Channel, size_t Count, uint8_t *Payload, uint64_t FirstBit);
+
+//------------------------------------------------------------------------------
+//Store payload bits [FirstBit, FirstBit + NumBits) in the channels selected by
+//Format among Count channels. Phase is the channel (0 blue, 1 green, 2 red) of
+//Channel[0]. Stops at whichever comes first, NumBits or Count.
+void lsb_embed_format(uint8_t *Channel, size_t Count, unsigned Phase, const lsb_format_t *Format,
+					  const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits);
+//------------------------------------------------------------------------------
+//Recover payload bits stored by lsb_embed_format()
+void lsb_extract_format(const uint8_t *Channel, size_t Count, unsigned Phase, const lsb_format_t *Format,
+						uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits);
+
+//================================ PIXEL ROWS ==================================
+
+//------------------------------------------------------------------------------
+//Same as lsb_embed_format() over Count channel slots of a run of pixels laid out
+//as Layout, from slot Column of the run (Pixels points to its first pixel).
+//Palette indexes whose bit changes take the Layout->Nearest index instead.
+void lsb_embed_row(uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count, unsigned Phase,
+				   const lsb_format_t *Format, const uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits);
+//------------------------------------------------------------------------------
+//Recover payload bits stored by lsb_embed_row()
+void lsb_extract_row(const uint8_t *Pixels, const pixel_layout_t *Layout, uint64_t Column, size_t Count,
+					 unsigned Phase, const lsb_format_t *Format, uint8_t *Payload, uint64_t FirstBit, uint64_t NumBits);
+
+//=============================== DENSITY FORMAT ===============================
+
+//------------------------------------------------------------------------------
+//Payload bits held by NumSlots channel slots starting at slot FirstSlot
+uint64_t lsb_format_bits(const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumSlots);
+//------------------------------------------------------------------------------
+//Number of channel slots, starting at slot FirstSlot, needed to hold NumBits
+//payload bits
+uint64_t lsb_format_slots(const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumBits);
+//------------------------------------------------------------------------------
+//Non zero if the format is valid
+int lsb_format_valid(const lsb_format_t *Format);
+//------------------------------------------------------------------------------
+//Non zero if payload bits can be stored with the format in pixels laid out as
+//Layout. Palette indexes only take the default format (they have no channels,
+//and a nearest color is only known for the other lowest bit).
+int lsb_format_fits_layout(const lsb_format_t *Format, const pixel_layout_t *Layout);
+
+//================================ IMAGE LEVEL =================================
+
+//------------------------------------------------------------------------------
+//Store NumBits payload bits in the image starting at channel slot FirstSlot
+void lsb_embed_img(img24_t *Img, const uint8_t *Payload, uint64_t FirstSlot, uint64_t NumBits);
+//------------------------------------------------------------------------------
+//Recover NumBits payload bits from the image starting at channel slot FirstSlot
+void lsb_extract_img(const img24_t *Img, uint8_t *Payload, uint64_t FirstSlot, uint64_t NumBits);
+//------------------------------------------------------------------------------
+//Store NumBits payload bits in the image starting at channel slot FirstSlot,
+//with the given density format, on NumThreads threads
+void lsb_embed_img_format(img24_t *Img, const lsb_format_t *Format, const uint8_t *Payload,
+						  uint64_t FirstSlot, uint64_t NumBits, int NumThreads);
+//------------------------------------------------------------------------------
+//Recover payload bits stored by lsb_embed_img_format()
+void lsb_extract_img_format(const img24_t *Img, const lsb_format_t *Format, uint8_t *Payload,
+							uint64_t FirstSlot, uint64_t NumBits, int NumThreads);
+
+
+#endif
@@ -7,44 +7,755 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "bitmap.h"
+#include "lsb.h"
+#include "payload.h"
+#include "stream.h"
+#include "batch.h"
+#include "compress.h"
+#include "shard.h"
+#include "plan.h"
+#include "crc.h"
+#include "fec.h"
 
 
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Print program usage
+static void print_usage(const char *ProgName)
+{
+	printf("\nUsage: %s [--flags] <option> <image_input> <file_to_attach_or_extract_to> [image_output]\n", ProgName);
+	printf("       %s p <image_or_directory> [...]\n", ProgName);
+	printf("       %s [-j N] b <manifest>\n", ProgName);
+	printf("       %s u <image> <new_file_to_attach>\n", ProgName);
+	printf("       %s [-j N] v <image> [...]\n", ProgName);
+	printf("       %s s <file_to_attach> <image> [...]\n", ProgName);
+	printf("       %s j <file_output> <image> [...]\n", ProgName);
+	printf("       %s a <manifest_output> <image_or_directory> <file_to_attach> [...]\n\n", ProgName);
+	printf("<option>:\n");
+	printf(" i  --> Show information on payload size limit that can be attached to the image.\n");
+	printf("       Only the headers are read. Alone it accepts any number of images:\n");
+	printf("       %s i <image> [...]\n\n", ProgName);
+	printf(" x  --> Extract payload from image. The CRC32C recorded when it was attached\n");
+	printf("       is checked on the way.\n\n");
+	printf(" v  --> Verify the payload of each image against its CRC32C, writing nothing.\n\n");
+	printf(" c  --> Attach payload to image. The image file is patched in place, only\n");
+	printf("       the pixel bytes whose LSB changes are rewritten. If [image_output] is\n");
+	printf("       given the image is streamed to it instead, using constant memory.\n\n");
+	printf(" u  --> Update the payload of an image in place. The old payload is read back\n");
+	printf("       and only the bytes that changed are stored (appended bytes directly),\n");
+	printf("       with the density and compression the image already uses.\n\n");
+	printf(" p  --> Probe images (directories are searched recursively) and list the ones\n");
+	printf("       carrying a payload. Only headers and the first pixels are read.\n\n");
+	printf(" b  --> Run a batch of jobs listed in a manifest, one per line:\n");
+	printf("         c <image> <file_to_attach> [image_output]\n");
+	printf("         x <image> <file_output>\n");
+	printf("         s <file_to_attach> <image> [...]\n");
+	printf("       Images are read, processed (by -j N threads) and written in a\n");
+	printf("       pipeline. A failed job is reported and the batch goes on.\n\n");
+	printf(" s  --> Split a payload too big for one image across several images, in\n");
+	printf("       order. Each image holds a shard that records its place in the payload.\n\n");
+	printf(" j  --> Join the shards of a payload, images given in any order. All images\n");
+	printf("       are read at once (-j N limits it to N).\n\n");
+	printf(" a  --> Plan where to attach the files: the headers of every image under the\n");
+	printf("       directory are read (%d at once, -j N to change it) and each file is\n", PLAN_DEFAULT_WORKERS);
+	printf("       given the smallest free image it fits in, or split across as few\n");
+	printf("       images as possible. The plan is written as a manifest for b mode.\n\n");
+	printf(" Options can be combined.Ex.:\n");
+	printf(" Show info and attach payload: %s ic img.bmp file_input\n", ProgName);
+	printf(" Show info and extract payload: %s ix img.bmp file_output\n\n", ProgName);
+	printf("[--flags]:\n");
+	printf(" --window=<size>  --> Memory used by streaming (default 8M, K/M/G suffixes).\n");
+	printf(" -j <N>           --> Split the image in row bands processed by N threads.\n");
+	printf(" --depth=<N>      --> Jobs in flight in batch mode (default: threads + 2).\n");
+	printf(" --bits=<N>       --> Payload bits stored per channel, 1 to 4 (default 1).\n");
+	printf(" --channels=<RGB> --> Channels carrying payload, e.g. B or RG (default RGB).\n");
+	printf("                      Extraction reads the density from the image.\n");
+	printf("                      8 bpp palette images take neither, they hold 1 bit per\n");
+	printf("                      palette index, changed to the nearest color.\n");
+	printf(" --range=<off>[:<len>] --> Extract only payload bytes [off, off + len), reading\n");
+	printf("                      just the image rows that hold them (K/M/G suffixes).\n");
+	printf(" --key=<phrase>   --> Scatter the payload over the image in an order given by\n");
+	printf("                      the key, which is then needed to extract it.\n");
+	printf(" --compress       --> Compress the payload before attaching it. Extraction\n");
+	printf("                      decompresses it on the fly.\n");
+	printf(" --fec=<N>        --> Store N Reed-Solomon parity bytes per 255 (2 to %d), so\n", FEC_MAX_PARITY);
+	printf("                      up to N/2 damaged bytes in each are repaired on extraction.\n");
+	printf(" --kernel=<name>  --> Force pixel kernel: auto (default), scalar, sse2, avx2, avx512.\n");
+	printf(" --self-test      --> Check every pixel kernel the CPU supports against the\n");
+	printf("                      scalar kernel and exit.\n");
+	printf(" --bench          --> Time every pixel kernel the CPU supports and exit.\n\n");
+}
+
+/******************************************************************************/
+//Read a size with an optional K, M or G suffix. End is left after the size.
+static uint64_t parse_size(const char *String, char **End)
+{
+	uint64_t	Size = strtoull(String, End, 10);
+	
+	switch(**End)
+	{
+		case 'G': case 'g':
+			Size <<= 10;
+			//fall through
+		case 'M': case 'm':
+			Size <<= 10;
+			//fall through
+		case 'K': case 'k':
+			Size <<= 10;
+			(*End)++;
+	}
+	
+	return Size;
+}
+
+/******************************************************************************/
+//Copy a file as is. Returns 0 on success.
+static int copy_file(const char *InputName, const char *OutputName)
+{
+	FILE		*Input;
+	FILE		*Output;
+	uint8_t		Buffer[1 << 16];
+	size_t		Count;
+	int			Result = 0;
+	
+	Input = fopen(InputName, "rb");
+	if(Input == NULL)
+		return -1;
+	
+	Output = fopen(OutputName, "wb");
+	if(Output == NULL)
+	{
+		fclose(Input);
+		return -1;
+	}
+	
+	while((Count = fread(Buffer, 1, sizeof(Buffer), Input)) > 0)
+	{
+		if(fwrite(Buffer, 1, Count, Output) != Count)
+		{
+			Result = -1;
+			break;
+		}
+	}
+	
+	if(ferror(Input))
+		Result = -1;
+	fclose(Input);
+	if(fclose(Output) != 0)
+		Result = -1;
+	
+	return Result;
+}
+
+/******************************************************************************/
+//CRC32C of a file from its current position to the end, which it is left at
+static int file_crc(FILE *Input, uint32_t *Crc)
+{
+	uint8_t		Buffer[1 << 16];
+	size_t		Count;
+	
+	*Crc = 0;
+	while((Count = fread(Buffer, 1, sizeof(Buffer), Input)) > 0)
+		*Crc = crc32c(*Crc, Buffer, Count);
+	
+	return ferror(Input) ? -1 : 0;
+}
+
+/******************************************************************************/
+//Show the max payload that can be attached to an image of the given dimensions
+static void print_capacity(const char *Name, const dimensions_t *Dimension, const lsb_format_t *Format)
+{
+	uint64_t MaxPayloadSize = payload_capacity(LSB_IMG_SLOTS(Dimension), Format);
+	
+	if(Name != NULL)
+		printf("%s (%d x %d): ", Name, Dimension->Width, Dimension->Height);
+	
+	//Palette indexes have no channels
+	if(!lsb_format_fits_layout(Format, &Dimension->Layout))
+	{
+		printf("Palette image, it takes 1 bit per palette index only (no --bits or --channels)\n");
+		return;
+	}
+	if(Dimension->Layout.BytesPerPixel == 1)
+	{
+		printf("Max file size to be Attached (bytes): %" PRIu64 "\t%.3fK\t%.3fM\t(1 bit per palette index)\n",
+			   MaxPayloadSize, MaxPayloadSize/1000.0, MaxPayloadSize/1000000.0);
+		return;
+	}
+	
+	printf("Max file size to be Attached (bytes): %" PRIu64 "\t%.3fK\t%.3fM\t(%d bit%s per channel, %s%s%s)\n",
+			MaxPayloadSize, MaxPayloadSize/1000.0, MaxPayloadSize/1000000.0, Format->Bits, (Format->Bits > 1) ? "s" : "",
+			(Format->Channels & LSB_RED) ? "R" : "", (Format->Channels & LSB_GREEN) ? "G" : "",
+			(Format->Channels & LSB_BLUE) ? "B" : "");
+}
+
+/******************************************************************************/
+//Show capacity of an image file reading its headers only. Returns 0 on success.
+static int info_path(const char *Path, uint8_t ShowName, const lsb_format_t *Format)
+{
+	dimensions_t	Dimension;
+	FILE			*Image;
+	int				Result;
+	
+	Image = fopen(Path, "rb");
+	if(Image == NULL)
+	{
+		printf("%s: could not be read\n", Path);
+		return -1;
+	}
+	
+	Result = read_dimensions_BMP(Image, &Dimension);
+	fclose(Image);
+	
+	if(Result != BMP_OK)
+	{
+		printf("%s: not a supported BMP image\n", Path);
+		return -1;
+	}
+	if(!BMP_CAN_CARRY(&Dimension))
+	{
+		printf("%s: %s\n", Path, bmp_error(BMP_ERROR_FORMAT));
+		return -1;
+	}
+	
+	print_capacity(ShowName ? Path : NULL, &Dimension, Format);
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Probe an image, or every file under a directory, for a payload. Returns the
+//number of images carrying a payload.
+static int probe_path(const char *Path)
+{
+	struct stat			PathStat;
+	DIR					*Directory;
+	struct dirent		*Entry;
+	char				*EntryPath;
+	payload_header_t	Header;
+	int					Found = 0;
+	int					Result;
+	
+	if(stat(Path, &PathStat) != 0)
+	{
+		printf("%s: could not be read\n", Path);
+		return 0;
+	}
+	
+	if(S_ISDIR(PathStat.st_mode))
+	{
+		Directory = opendir(Path);
+		if(Directory == NULL)
+		{
+			printf("%s: could not be read\n", Path);
+			return 0;
+		}
+		
+		while((Entry = readdir(Directory)) != NULL)
+		{
+			if((strcmp(Entry->d_name, ".") == 0) || (strcmp(Entry->d_name, "..") == 0))
+				continue;
+			
+			EntryPath = malloc(strlen(Path) + strlen(Entry->d_name) + 2);
+			if(EntryPath == NULL)
+				break;
+			
+			sprintf(EntryPath, "%s/%s", Path, Entry->d_name);
+			Found += probe_path(EntryPath);
+			free(EntryPath);
+		}
+		
+		closedir(Directory);
+		return Found;
+	}
+	
+	if(!S_ISREG(PathStat.st_mode))
+		return 0;
+	
+	//Files that are not images or carry no payload are skipped silently
+	Result = payload_probe(Path, &Header);
+	if(Result == PAYLOAD_OK)
+	{
+		printf("%s: payload of %" PRIu64 " bytes", Path, Header.OriginalLength);
+		if(Header.Flags & PAYLOAD_COMPRESSED)
+			printf(" (compressed to %" PRIu64 " bytes)", Header.Length);
+		if(Header.ShardCount > 1)
+			printf(", shard %d/%d at payload byte %" PRIu64, Header.ShardIndex + 1, Header.ShardCount, Header.ShardOffset);
+		if(Header.Flags & PAYLOAD_SCATTERED)
+			printf(", scattered with a key");
+		if(Header.Flags & PAYLOAD_FEC)
+			printf(", error correction %d/%d", Header.FecParity, FEC_CODEWORD);
+		printf("\n");
+		return 1;
+	}
+	if((Result == PAYLOAD_BAD_CHECKSUM) || (Result == PAYLOAD_BAD_VERSION))
+		printf("%s: %s\n", Path, payload_error(Result));
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Replace the payload of an image in place, keeping its density and compression.
+//Only the payload bytes that changed are stored, so the pixels rewritten follow
+//the size of the change rather than the size of the payload. Keyed tells
+//whether a key was given, which must match the payload in the image.
+static void update_image(const char *ImageName, const char *PayloadName, uint8_t Keyed, int NumThreads)
+{
+	img24_t				*Image;
+	payload_header_t	OldHeader;
+	payload_header_t	NewHeader;
+	lsb_format_t		Format;
+	FILE				*Payload;
+	uint8_t				*PayloadBuffer;
+	uint8_t				*Packed = NULL;
+	uint64_t			PayloadSize;
+	uint64_t			StoredSize;
+	int64_t				Stored;
+	int					Result;
+	
+	Image = map_BMP(ImageName, 1);
+	
+	//Scattered payloads stay scattered with the same key and the others stay
+	//in order, checked before anything is written
+	Result = payload_read_header(Image, &OldHeader);
+	if((Result == PAYLOAD_BAD_KEY) && !Keyed)
+	{
+		printf("Could not update payload: the payload in the image is scattered, give its key with --key.\n");
+		exit(EXIT_FAILURE);
+	}
+	if(Result != PAYLOAD_OK)
+	{
+		printf("Could not update payload: %s!\n", payload_error(Result));
+		exit(EXIT_FAILURE);
+	}
+	if(!(OldHeader.Flags & PAYLOAD_SCATTERED) && Keyed)
+	{
+		printf("Could not update payload: the payload in the image is not scattered, update it without --key.\n");
+		exit(EXIT_FAILURE);
+	}
+	if(OldHeader.ShardCount > 1)
+	{
+		printf("Could not update payload: image holds one shard of %d, attach the whole set again with option s.\n",
+			   OldHeader.ShardCount);
+		exit(EXIT_FAILURE);
+	}
+	
+	Payload = fopen(PayloadName, "rb");
+	if(Payload == NULL)
+	{
+		printf("Could not open payload file!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	fseek(Payload, 0, SEEK_END);
+	PayloadSize = ftell(Payload);
+	rewind(Payload);
+	
+	PayloadBuffer = malloc(PayloadSize + 1);
+	if((PayloadBuffer == NULL) || (fread(PayloadBuffer, 1, PayloadSize, Payload) != PayloadSize))
+	{
+		printf("Could not read payload file!\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(Payload);
+	
+	//Blocks are compressed independently, so unchanged blocks compress to the
+	//same bytes as before. Parity is kept as it was too.
+	payload_set_fec((OldHeader.Flags & PAYLOAD_FEC) ? OldHeader.FecParity : 0);
+	StoredSize = PayloadSize;
+	if(OldHeader.Flags & PAYLOAD_COMPRESSED)
+	{
+		Packed = malloc(COMPRESS_BOUND(PayloadSize));
+		if(Packed == NULL)
+		{
+			printf("Could not allocate memory for compression!\n");
+			exit(EXIT_FAILURE);
+		}
+		StoredSize = compress_buffer(PayloadBuffer, PayloadSize, Packed);
+	}
+	
+	Format = payload_format(&OldHeader);
+	payload_make_header(&NewHeader, StoredSize, &Format);
+	if(!payload_fits(&NewHeader, LSB_IMG_SLOTS(Image)))
+	{
+		printf("Payload is too big for this image! (%" PRIu64 " bytes%s, max %" PRIu64 " bytes)\n", StoredSize,
+			   (Packed != NULL) ? " compressed" : "", payload_capacity(LSB_IMG_SLOTS(Image), &Format));
+		exit(EXIT_FAILURE);
+	}
+	
+	if(Packed != NULL)
+	{
+		NewHeader.Flags |= PAYLOAD_COMPRESSED;
+		NewHeader.OriginalLength = PayloadSize;
+		payload_seal_header(&NewHeader);
+	}
+	
+	Stored = payload_update_img(Image, &OldHeader, &NewHeader, (Packed != NULL) ? Packed : PayloadBuffer, NumThreads);
+	if(Stored < 0)
+	{
+		printf("Could not allocate memory for the update!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	printf("Payload updated from %" PRIu64 " to %" PRIu64 " bytes%s, %" PRId64 " bytes stored\n", OldHeader.Length,
+		   StoredSize, (Packed != NULL) ? " (compressed)" : "", Stored);
+	
+	free(Packed);
+	free(PayloadBuffer);
+	free_img(Image);
+}
+
+/******************************************************************************/
+//Read back the payload of an image and check it against the CRC32C in its
+//container header. Nothing is written, compressed payloads are still decoded.
+//Returns 0 if the payload is intact.
+static int verify_image(const char *ImageName, int NumThreads)
+{
+	img24_t				*Image;
+	payload_header_t	Header;
+	uint64_t			Repaired = 0;
+	int					Result;
+	
+	Result = try_map_BMP(ImageName, 0, &Image);
+	if(Result != BMP_OK)
+	{
+		printf("%s: %s\n", ImageName, bmp_error(Result));
+		return -1;
+	}
+	
+	Result = payload_read_header(Image, &Header);
+	if((Result == PAYLOAD_OK) && !payload_fits(&Header, LSB_IMG_SLOTS(Image)))
+		Result = PAYLOAD_READ_ERROR;
+	if(Result == PAYLOAD_OK)
+		Result = payload_extract_file(Image, &Header, NULL, NumThreads, &Repaired);
+	
+	if(Result != PAYLOAD_OK)
+		printf("%s: FAILED, %s\n", ImageName, payload_error(Result));
+	else if(Header.Flags & PAYLOAD_HAS_CRC)
+		printf("%s: OK, %" PRIu64 " bytes, CRC32C %08" PRIx32, ImageName, Header.Length, Header.PayloadCrc);
+	else
+		printf("%s: OK, %" PRIu64 " bytes, no checksum recorded", ImageName, Header.Length);
+	
+	//Repaired bytes are not written back, the image keeps its damage
+	if((Result == PAYLOAD_OK) && (Header.Flags & PAYLOAD_FEC))
+		printf(", %" PRIu64 " bytes repaired\n", Repaired);
+	else if(Result == PAYLOAD_OK)
+		printf("\n");
+	
+	free_img(Image);
+	
+	return (Result == PAYLOAD_OK) ? 0 : -1;
+}
+
+/******************************************************************************/
 int main(int argc, char *argv[])
 {
-	char		*Signature = "stegVHAHSS";
 	uint8_t		PayloadInfoFlag = 0;
 	uint8_t		ExtractPayloadFlag = 0;
 	uint8_t		AttachPayloadFlag = 0;
+	uint8_t		SelfTestFlag = 0;
+	uint8_t		BenchFlag = 0;
+	uint8_t		CompressFlag = 0;
+	uint8_t		RangeFlag = 0;
+	uint64_t	RangeOffset = 0;
+	uint64_t	RangeLength = UINT64_MAX;
+	
+	char		*KernelName = NULL;
+	char		*KeyName = NULL;
+	int			NumThreads = 0;				//0 until given with -j
+	int			Depth = 0;
+	lsb_format_t	Format = {1, LSB_ALL_CHANNELS};
+	size_t		WindowSize = STREAM_DEFAULT_WINDOW;
+	char		*Suffix;
+	char		**Args;
+	int			NumArgs = 0;
+	int			Found = 0;
 	
 	FILE		*Payload = NULL;
 	img24_t		*Image = NULL;
+	dimensions_t	Dimension;
+	payload_header_t	Header;
+	int			Result;
+	
+	uint8_t		*PayloadBuffer = NULL;
+	uint64_t	PayloadSize = 0;
+	uint64_t	OriginalSize = 0;
+	FILE		*Packed;
+	int64_t		PackedSize;
+	uint64_t	MaxPayloadSize = 0;
+	uint64_t	Repaired = 0;
+	uint32_t	PayloadCrc;
+	int			FecParity = 0;
+	
+	//Separate flags from positional arguments
+	Args = malloc(argc * sizeof(char *));
+	if(Args == NULL)
+	{
+		printf("Could not allocate memory for arguments!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(int arg = 1; arg < argc; arg++)
+	{
+		if(strncmp(argv[arg], "--kernel=", 9) == 0)
+		{
+			KernelName = argv[arg] + 9;
+		}
+		else if(strncmp(argv[arg], "--key=", 6) == 0)
+		{
+			KeyName = argv[arg] + 6;
+		}
+		else if(strncmp(argv[arg], "-j", 2) == 0)
+		{
+			//Accept both "-j N" and "-jN"
+			if((argv[arg][2] == '\0') && (arg + 1 < argc))
+				arg++;
+			else if(argv[arg][2] != '\0')
+				argv[arg] += 2;
+			
+			NumThreads = atoi(argv[arg]);
+			if(NumThreads < 1)
+			{
+				printf("Invalid number of threads for -j!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strncmp(argv[arg], "--window=", 9) == 0)
+		{
+			WindowSize = parse_size(argv[arg] + 9, &Suffix);
+			if((WindowSize == 0) || (*Suffix != '\0'))
+			{
+				printf("Invalid window size!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strncmp(argv[arg], "--range=", 8) == 0)
+		{
+			//<offset>[:<length>], without a length up to the end of the payload
+			RangeFlag = 1;
+			RangeOffset = parse_size(argv[arg] + 8, &Suffix);
+			if(*Suffix == ':')
+				RangeLength = parse_size(Suffix + 1, &Suffix);
+			if((*Suffix != '\0') || (argv[arg][8] == ':'))
+			{
+				printf("Invalid range, use <offset>[:<length>]!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strncmp(argv[arg], "--depth=", 8) == 0)
+		{
+			Depth = atoi(argv[arg] + 8);
+			if(Depth < 1)
+			{
+				printf("Invalid pipeline depth!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strncmp(argv[arg], "--bits=", 7) == 0)
+		{
+			Format.Bits = atoi(argv[arg] + 7);
+			if((Format.Bits < 1) || (Format.Bits > LSB_MAX_BITS))
+			{
+				printf("Invalid number of bits per channel (1 to %d)!\n", LSB_MAX_BITS);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strncmp(argv[arg], "--channels=", 11) == 0)
+		{
+			Format.Channels = 0;
+			for(char *Letter = argv[arg] + 11; *Letter != '\0'; Letter++)
+			{
+				switch(*Letter)
+				{
+					case 'R': case 'r':
+						Format.Channels |= LSB_RED;
+						break;
+					case 'G': case 'g':
+						Format.Channels |= LSB_GREEN;
+						break;
+					case 'B': case 'b':
+						Format.Channels |= LSB_BLUE;
+						break;
+					default:
+						Format.Channels = 0;
+						Letter[1] = '\0';
+				}
+			}
+			if(Format.Channels == 0)
+			{
+				printf("Invalid channels, use letters R, G and B!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strcmp(argv[arg], "--compress") == 0)
+		{
+			CompressFlag = 1;
+		}
+		else if(strncmp(argv[arg], "--fec=", 6) == 0)
+		{
+			FecParity = atoi(argv[arg] + 6);
+			if((FecParity < 2) || (FecParity > FEC_MAX_PARITY))
+			{
+				printf("Invalid number of parity bytes (2 to %d)!\n", FEC_MAX_PARITY);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strcmp(argv[arg], "--self-test") == 0)
+		{
+			SelfTestFlag = 1;
+		}
+		else if(strcmp(argv[arg], "--bench") == 0)
+		{
+			BenchFlag = 1;
+		}
+		else if(strncmp(argv[arg], "--", 2) == 0)
+		{
+			printf("Invalid flag: %s\n", argv[arg]);
+			exit(EXIT_FAILURE);
+		}
+		else
+		{
+			Args[NumArgs++] = argv[arg];
+		}
+	}
+	
+	//Pixel kernels are selected once, from the CPU features or the override
+	if(lsb_select_kernel(KernelName) < 0)
+	{
+		printf("Pixel kernel \"%s\" is unknown or not supported by this CPU!\n", KernelName);
+		exit(EXIT_FAILURE);
+	}
 	
-	uint32_t	MaxPayloadSize = 0;
+	payload_set_key(KeyName);
+	payload_set_fec(FecParity);
+	
+	if(SelfTestFlag == 1)
+	{
+		if((lsb_self_test() != 0) || (crc32c_self_test() != 0) || (fec_self_test() != 0) ||
+		   (batch_self_test() != 0))
+			exit(EXIT_FAILURE);
+		
+		printf("Kernel in use: %s, CRC32C: %s, GF(2^8): %s\n", lsb_kernel_name(), crc32c_name(), fec_kernel_name());
+		return 0;
+	}
+	
+	if(BenchFlag == 1)
+	{
+		lsb_bench();
+		printf("Kernel in use: %s\n", lsb_kernel_name());
+		return 0;
+	}
+	
+	//Join mode reads every shard at once unless -j says otherwise
+	if((NumArgs >= 3) && (strcmp(Args[0], "j") == 0))
+	{
+		Result = shard_extract(Args[1], Args + 2, NumArgs - 2, (NumThreads > 0) ? NumThreads : NumArgs - 2);
+		
+		free(Args);
+		return (Result == 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	//Planning reads many headers at once unless -j says otherwise
+	if((NumArgs >= 4) && (strcmp(Args[0], "a") == 0))
+	{
+		Found = plan_run(Args[1], Args[2], Args + 3, NumArgs - 3, &Format, CompressFlag,
+						 (NumThreads > 0) ? NumThreads : PLAN_DEFAULT_WORKERS);
+		
+		free(Args);
+		return (Found == 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	if(NumThreads == 0)
+		NumThreads = 1;
+	
+	//Shard mode splits one payload across any number of images
+	if((NumArgs >= 3) && (strcmp(Args[0], "s") == 0))
+	{
+		Result = shard_embed(Args[1], Args + 2, NumArgs - 2, &Format, CompressFlag, NumThreads);
+		
+		free(Args);
+		return (Result == 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	//Probe mode takes any number of files and directories
+	if((NumArgs >= 2) && (strcmp(Args[0], "p") == 0))
+	{
+		for(int arg = 1; arg < NumArgs; arg++)
+			Found += probe_path(Args[arg]);
+		
+		free(Args);
+		return (Found > 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	//Batch mode runs the jobs of a manifest on NumThreads workers
+	if((NumArgs == 2) && (strcmp(Args[0], "b") == 0))
+	{
+		Found = batch_run(Args[1], NumThreads, Depth, &Format, CompressFlag);
+		if(Found < 0)
+			printf("Could not read manifest \"%s\"\n", Args[1]);
+		
+		free(Args);
+		return (Found == 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	//Update mode replaces the payload of an image storing only what changed
+	if((NumArgs == 3) && (strcmp(Args[0], "u") == 0))
+	{
+		update_image(Args[1], Args[2], KeyName != NULL, NumThreads);
+		
+		free(Args);
+		return 0;
+	}
+	
+	//Verify mode takes any number of images
+	if((NumArgs >= 2) && (strcmp(Args[0], "v") == 0))
+	{
+		for(int arg = 1; arg < NumArgs; arg++)
+		{
+			if(verify_image(Args[arg], NumThreads) != 0)
+				Found = -1;
+		}
+		
+		free(Args);
+		return (Found == 0) ? 0 : EXIT_FAILURE;
+	}
+	
+	//Info mode alone takes any number of images
+	if((NumArgs >= 2) && (strcmp(Args[0], "i") == 0))
+	{
+		for(int arg = 1; arg < NumArgs; arg++)
+		{
+			if(info_path(Args[arg], NumArgs > 2, &Format) != 0)
+				Found = -1;
+		}
+		
+		free(Args);
+		return (Found == 0) ? 0 : EXIT_FAILURE;
+	}
 	
 	//Verify program input
-	if(argc != 4)
-	{
-		printf("\nUsage: %s <option> <image_input> <file_to_attach_or_extract_to>\n\n", argv[0]);
-		printf("<option>:\n");
-		printf(" i  --> Show information on payload size limit that can be attached to the image.\n\n");
-		printf(" x  --> Extract payload from image.\n\n");
-		printf(" c  --> Attach payload to image.\n\n");
-		printf(" Options can be combined.Ex.:\n");
-		printf(" Show info and attach payload: %s ic img.bmp file_input\n", argv[0]);
-		printf(" Show info and extract payload: %s ix img.bmp file_output\n\n", argv[0]);		
+	if((NumArgs != 3) && (NumArgs != 4))
+	{
+		print_usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 	else
 	{
 		for(uint8_t i = 0;; i++)
 		{
-			if(argv[1][i] == '\0')
+			if(Args[0][i] == '\0')
 				break;
 			
-			switch (argv[1][i])
+			switch (Args[0][i])
 			{
 				case 'i':					//show info
 					PayloadInfoFlag = 1;
@@ -66,13 +777,52 @@ int main(int argc, char *argv[])
 			printf("Incompatible options used! Can't Extract and Attach at same time.\n");
 			exit(EXIT_FAILURE);
 		}
+		if((NumArgs == 4) && !AttachPayloadFlag)
+		{
+			printf("An output image can only be given when attaching a payload.\n");
+			exit(EXIT_FAILURE);
+		}
+		if(RangeFlag && !ExtractPayloadFlag)
+		{
+			printf("A range can only be given when extracting a payload.\n");
+			exit(EXIT_FAILURE);
+		}
 	}
 	
-	Image = read_BMP(argv[2]);
+	//Capacity needs the headers only
+	Dimension = dimensions_BMP(Args[1]);
+	MaxPayloadSize = payload_capacity(LSB_IMG_SLOTS(&Dimension), &Format);
+	if((AttachPayloadFlag == 1) && !lsb_format_fits_layout(&Format, &Dimension.Layout))
+	{
+		printf("Palette images take 1 bit per palette index only, attach without --bits or --channels.\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if(PayloadInfoFlag == 1)
+		print_capacity(NULL, &Dimension, &Format);
+	
+	//Image is mapped, not decoded. For attaching the mapping is shared with the
+	//file so the pixel matrix is patched in place and headers are kept as is.
+	//When streaming to an output image, or extracting a range, nothing is mapped.
+	//Scattered fields reach the whole image, which then can not go through the
+	//streaming window: the image is copied and the copy patched in place.
+	if((NumArgs == 4) && (KeyName != NULL))
+	{
+		if(copy_file(Args[1], Args[3]) != 0)
+		{
+			printf("Could not copy the image to the output image!\n");
+			exit(EXIT_FAILURE);
+		}
+		Image = map_BMP(Args[3], 1);
+	}
+	else if((NumArgs == 3) && !RangeFlag)
+	{
+		Image = map_BMP(Args[1], AttachPayloadFlag);
+	}
 	
 	if(ExtractPayloadFlag == 1)
 	{
-		Payload = fopen(argv[3], "wb");
+		Payload = fopen(Args[2], "wb");
 		if(Payload == NULL)
 		{
 			printf("Could not open payload file!\n");
@@ -81,7 +831,7 @@ int main(int argc, char *argv[])
 	}
 	else if(AttachPayloadFlag == 1)
 	{
-		Payload = fopen(argv[3], "rb");
+		Payload = fopen(Args[2], "rb");
 		if(Payload == NULL)
 		{
 			printf("Could not open payload file!\n");
@@ -89,26 +839,144 @@ int main(int argc, char *argv[])
 		}
 	}
 	
-	//Finding and showing max payload that can be attached to the image
-	MaxPayloadSize = (Image->Height * Image->Width * 3) / 8;
-	
-	if(PayloadInfoFlag == 1)
-		printf("Max file size to be Attached (bytes): %u\t%.3fK\t%.3fM\n",
-				MaxPayloadSize, MaxPayloadSize/1000.0, MaxPayloadSize/1000000.0);
-	
 	//Attaching or extracting payload from image
-	for(int32_t row = 0; row < Image->Height; row++)
+	if(AttachPayloadFlag == 1)
+	{
+		fseek(Payload, 0, SEEK_END);
+		PayloadSize = ftell(Payload);
+		rewind(Payload);
+		OriginalSize = PayloadSize;
+		
+		//Compressed into a temporary file, which then stands for the payload
+		if(CompressFlag == 1)
+		{
+			Packed = tmpfile();
+			if((Packed == NULL) || ((PackedSize = compress_file(Payload, Packed, &OriginalSize)) < 0))
+			{
+				printf("Could not compress payload file!\n");
+				exit(EXIT_FAILURE);
+			}
+			
+			fclose(Payload);
+			Payload = Packed;
+			PayloadSize = PackedSize;
+			rewind(Payload);
+			
+			if(PayloadInfoFlag == 1)
+				printf("Payload compressed from %" PRIu64 " to %" PRIu64 " bytes\n", OriginalSize, PayloadSize);
+		}
+		
+		if(PayloadSize > MaxPayloadSize)
+		{
+			printf("Payload is too big for this image! (%" PRIu64 " bytes%s, max %" PRIu64 " bytes)\n", PayloadSize,
+				   (CompressFlag == 1) ? " compressed" : "", MaxPayloadSize);
+			exit(EXIT_FAILURE);
+		}
+		
+		payload_make_header(&Header, PayloadSize, &Format);
+		if(CompressFlag == 1)
+		{
+			Header.Flags |= PAYLOAD_COMPRESSED;
+			Header.OriginalLength = OriginalSize;
+			payload_seal_header(&Header);
+		}
+	}
+	
+	if((AttachPayloadFlag == 1) && (Image == NULL))
 	{
-		for(int32_t column = 0; column < Image->Width; column++)
+		//Streaming reads the bytes as stored, so parity is added into a
+		//temporary file first
+		if(FecParity > 0)
 		{
+			Packed = tmpfile();
+			if((Packed == NULL) || (fec_encode_file(Payload, Packed, FecParity) < 0))
+			{
+				printf("Could not add error correction to payload file!\n");
+				exit(EXIT_FAILURE);
+			}
 			
+			fclose(Payload);
+			Payload = Packed;
+			rewind(Payload);
 		}
+		
+		//The container header goes out with the first rows, before the payload
+		//is read, so its CRC takes a pass of its own
+		if(file_crc(Payload, &PayloadCrc) != 0)
+		{
+			printf("Could not read payload file!\n");
+			exit(EXIT_FAILURE);
+		}
+		rewind(Payload);
+		payload_set_crc(&Header, PayloadCrc);
+		
+		stream_embed(Args[1], Args[3], &Header, Payload, payload_stored_length(&Header), WindowSize);
 	}
-
+	else if(AttachPayloadFlag == 1)
+	{
+		PayloadBuffer = malloc(PayloadSize + 1);
+		if((PayloadBuffer == NULL) || (fread(PayloadBuffer, 1, PayloadSize, Payload) != PayloadSize))
+		{
+			printf("Could not read payload file!\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		payload_embed_img(Image, &Header, PayloadBuffer, NumThreads);
+	}
+	else if((ExtractPayloadFlag == 1) && (RangeFlag == 1))
+	{
+		//Only the rows holding the range are read
+		Result = payload_extract_range(Args[1], RangeOffset, RangeLength, Payload, &Header);
+		if(Result != PAYLOAD_OK)
+		{
+			printf("Could not extract payload: %s!\n", payload_error(Result));
+			exit(EXIT_FAILURE);
+		}
+		
+		if(Header.ShardCount > 1)
+			printf("Image holds shard %d of %d only, the range is taken from its part of the payload "
+				   "(payload bytes from %" PRIu64 ").\n", Header.ShardIndex + 1, Header.ShardCount, Header.ShardOffset);
+	}
+	else if(ExtractPayloadFlag == 1)
+	{
+		//Container header tells where the payload ends
+		Result = payload_read_header(Image, &Header);
+		if(Result != PAYLOAD_OK)
+		{
+			printf("Could not extract payload: %s!\n", payload_error(Result));
+			exit(EXIT_FAILURE);
+		}
+		
+		//Capacity with the density the payload was stored with
+		if(!payload_fits(&Header, LSB_IMG_SLOTS(&Dimension)))
+		{
+			printf("Could not extract payload: recorded length exceeds image capacity!\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		if(Header.ShardCount > 1)
+			printf("Image holds shard %d of %d only (payload bytes from %" PRIu64 "), use option j to join them.\n",
+				   Header.ShardIndex + 1, Header.ShardCount, Header.ShardOffset);
+		
+		//Written a chunk at a time, decompressed on the way if needed
+		Result = payload_extract_file(Image, &Header, Payload, NumThreads, &Repaired);
+		if(Result != PAYLOAD_OK)
+		{
+			printf("Could not extract payload: %s!\n", payload_error(Result));
+			exit(EXIT_FAILURE);
+		}
+		
+		if(Repaired > 0)
+			printf("Error correction repaired %" PRIu64 " damaged bytes.\n", Repaired);
+	}
+	
 	if((ExtractPayloadFlag == 1) || (AttachPayloadFlag == 1))
 		fclose(Payload);
 	
-	free_img(Image);
+	free(PayloadBuffer);
+	if(Image != NULL)
+		free_img(Image);
+	free(Args);
 	return 0;
 }
 
@@ -0,0 +1,883 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the payload container stored in the image						*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lsb.h"
+#include "compress.h"
+#include "scatter.h"
+#include "crc.h"
+#include "fec.h"
+#include "payload.h"
+
+
+_Static_assert(sizeof(payload_header_t) == PAYLOAD_HEADER_SIZE, "container header must be 64 bytes");
+
+//Payload bytes embedded or extracted at once, times the bits per channel so
+//every chunk starts on a channel field boundary. The CRC32C of a chunk is
+//folded in while it is still in cache.
+#define EXTRACT_CHUNK	(1 << 20)
+
+//Error correction groups handled at once, times the bits per channel
+#define FEC_CHUNK_GROUPS	16
+
+//Equal bytes that end a run of changed bytes in payload_update_img(). Shorter
+//gaps are stored with the run, which costs less than another call.
+#define UPDATE_GAP		16
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Key set by payload_set_key()
+static uint64_t ScatterKey;
+static uint8_t ScatterKeySet = 0;
+
+//Parity bytes per codeword set by payload_set_fec()
+static unsigned FecParity = 0;
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//32 bit FNV-1a hash
+static uint32_t fnv1a(const uint8_t *Data, size_t Size)
+{
+	uint32_t Hash = 2166136261u;
+	
+	for(size_t i = 0; i < Size; i++)
+	{
+		Hash ^= Data[i];
+		Hash *= 16777619u;
+	}
+	
+	return Hash;
+}
+
+/******************************************************************************/
+//Extract NumBits payload bits stored with Format from channel slot FirstSlot on,
+//straight from the pixel matrix of an open image file. Only the rows holding
+//them are read. Returns -1 if the file is too short.
+static int read_slots(FILE *Image, const dimensions_t *Dimension, const lsb_format_t *Format, uint64_t FirstSlot,
+					  uint64_t NumBits, uint8_t *Payload)
+{
+	uint8_t		Buffer[4096];
+	uint64_t	RowSlots = LSB_ROW_SLOTS(Dimension);
+	uint8_t		BytesPerPixel = Dimension->Layout.BytesPerPixel;
+	uint8_t		SlotsPerPixel = Dimension->Layout.SlotsPerPixel;
+	uint64_t	MaxSlots = sizeof(Buffer) / BytesPerPixel * SlotsPerPixel;
+	uint64_t	Slot = FirstSlot;
+	uint64_t	Bit = 0;
+	uint64_t	Row;
+	uint64_t	FileRow;
+	uint64_t	Pixel;
+	unsigned	Lead;
+	size_t		Count;
+	size_t		Size;
+	
+	while(Bit < NumBits)
+	{
+		//Channels of one row, at most one buffer of whole pixels at a time
+		Row = Slot / RowSlots;
+		Pixel = Slot % RowSlots / SlotsPerPixel;
+		Lead = Slot % RowSlots % SlotsPerPixel;
+		Count = RowSlots - Slot % RowSlots;
+		if(Count > lsb_format_slots(Format, Slot, NumBits - Bit))
+			Count = lsb_format_slots(Format, Slot, NumBits - Bit);
+		if(Count > MaxSlots - Lead)
+			Count = MaxSlots - Lead;
+		Size = (Lead + Count + SlotsPerPixel - 1) / SlotsPerPixel * BytesPerPixel;
+		
+		FileRow = Dimension->TopDown ? (Dimension->Height - 1 - Row) : Row;
+		
+		if((fseeko(Image, Dimension->OffsetPixelMatrix + FileRow * Dimension->Stride + Pixel * BytesPerPixel,
+				   SEEK_SET) != 0) ||
+		   (fread(Buffer, 1, Size, Image) != Size))
+			return -1;
+		
+		lsb_extract_row(Buffer, &Dimension->Layout, Lead, Count, Slot % 3, Format, Payload, Bit, NumBits - Bit);
+		Bit += lsb_format_bits(Format, Slot, Count);
+		Slot += Count;
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Read the dimensions and the container header of an open image file
+static int probe_file(FILE *Image, dimensions_t *Dimension, payload_header_t *Header)
+{
+	lsb_format_t	HeaderFormat = {1, LSB_ALL_CHANNELS};
+	
+	memset(Header, 0, sizeof(payload_header_t));
+	
+	if((read_dimensions_BMP(Image, Dimension) != BMP_OK) || !BMP_CAN_CARRY(Dimension))
+		return PAYLOAD_NOT_CARRIER;
+	
+	if(LSB_IMG_SLOTS(Dimension) < PAYLOAD_HEADER_SLOTS)
+		return PAYLOAD_NO_SIGNATURE;
+	
+	//Signature first, the rest of the container header only if it matches
+	if(read_slots(Image, Dimension, &HeaderFormat, 0, PAYLOAD_SIGNATURE_SIZE * 8, (uint8_t *)Header) < 0)
+		return PAYLOAD_NOT_CARRIER;
+	if(memcmp(Header->Signature, PAYLOAD_SIGNATURE, PAYLOAD_SIGNATURE_SIZE) != 0)
+		return PAYLOAD_NO_SIGNATURE;
+	if(read_slots(Image, Dimension, &HeaderFormat, PAYLOAD_SIGNATURE_SIZE * 8,
+				  PAYLOAD_HEADER_SLOTS - PAYLOAD_SIGNATURE_SIZE * 8, (uint8_t *)Header + PAYLOAD_SIGNATURE_SIZE) < 0)
+		return PAYLOAD_NOT_CARRIER;
+	
+	return payload_check_header(Header);
+}
+
+/******************************************************************************/
+//Store payload bits [FirstBit, FirstBit + NumBits) in the order the header
+//gives: in sequence after the container header, or scattered with the key.
+//Payload starts at bit FirstBit, a multiple of the bits per channel.
+static void embed_bits(img24_t *Img, const payload_header_t *Header, const uint8_t *Payload, uint64_t FirstBit,
+					   uint64_t NumBits, int NumThreads)
+{
+	lsb_format_t	Format = payload_format(Header);
+	scatter_t		Scatter;
+	
+	if(Header->Flags & PAYLOAD_SCATTERED)
+	{
+		scatter_init(&Scatter, ScatterKey, &Format, PAYLOAD_HEADER_SLOTS, LSB_IMG_SLOTS(Img));
+		scatter_embed_img(Img, &Scatter, Payload, FirstBit, NumBits, NumThreads);
+	}
+	else
+	{
+		lsb_embed_img_format(Img, &Format, Payload, PAYLOAD_HEADER_SLOTS +
+							 lsb_format_slots(&Format, PAYLOAD_HEADER_SLOTS, FirstBit), NumBits, NumThreads);
+	}
+}
+
+/******************************************************************************/
+//Recover payload bits stored by embed_bits()
+static void extract_bits(const img24_t *Img, const payload_header_t *Header, uint8_t *Payload, uint64_t FirstBit,
+						 uint64_t NumBits, int NumThreads)
+{
+	lsb_format_t	Format = payload_format(Header);
+	scatter_t		Scatter;
+	
+	if(Header->Flags & PAYLOAD_SCATTERED)
+	{
+		scatter_init(&Scatter, ScatterKey, &Format, PAYLOAD_HEADER_SLOTS, LSB_IMG_SLOTS(Img));
+		scatter_extract_img(Img, &Scatter, Payload, FirstBit, NumBits, NumThreads);
+	}
+	else
+	{
+		lsb_extract_img_format(Img, &Format, Payload, PAYLOAD_HEADER_SLOTS +
+							   lsb_format_slots(&Format, PAYLOAD_HEADER_SLOTS, FirstBit), NumBits, NumThreads);
+	}
+}
+
+/******************************************************************************/
+//Store payload bytes [Start, End) in the image, widened to channel field
+//boundaries. Returns the number of bytes stored.
+static uint64_t store_bytes(img24_t *Img, const payload_header_t *Header, const uint8_t *Payload, uint64_t Start,
+							uint64_t End, int NumThreads)
+{
+	lsb_format_t	Format = payload_format(Header);
+	
+	Start -= Start % Format.Bits;
+	End += (Format.Bits - End % Format.Bits) % Format.Bits;
+	if(End > payload_stored_length(Header))
+		End = payload_stored_length(Header);
+	
+	embed_bits(Img, Header, Payload + Start, Start * 8, (End - Start) * 8, NumThreads);
+	
+	return End - Start;
+}
+
+/******************************************************************************/
+//Payload bytes handled at once. Every chunk starts on a channel field boundary
+//and, with error correction, on a group boundary.
+static uint64_t chunk_length(const payload_header_t *Header)
+{
+	lsb_format_t Format = payload_format(Header);
+	
+	if(Header->Flags & PAYLOAD_FEC)
+		return FEC_GROUP_DATA(Header->FecParity) * FEC_CHUNK_GROUPS * Format.Bits;
+	
+	return (uint64_t)EXTRACT_CHUNK * Format.Bits;
+}
+
+/******************************************************************************/
+//Position in the stored bytes of payload byte Offset, a chunk boundary or the
+//payload end
+static uint64_t stored_offset(const payload_header_t *Header, uint64_t Offset)
+{
+	if(Header->Flags & PAYLOAD_FEC)
+		return fec_encoded_size(Offset, Header->FecParity);
+	
+	return Offset;
+}
+
+/******************************************************************************/
+//Store payload bytes [Done, Done + Count), Done being a chunk boundary. With
+//error correction they are encoded in Scratch first. The CRC32C of the bytes
+//as stored is folded into Crc.
+static void embed_chunk(img24_t *Img, const payload_header_t *Header, const uint8_t *Payload, uint64_t Done,
+						uint64_t Count, uint8_t *Scratch, uint32_t *Crc, int NumThreads)
+{
+	uint64_t Start = stored_offset(Header, Done);
+	
+	if(Header->Flags & PAYLOAD_FEC)
+	{
+		Count = fec_encode(Payload + Done, Count, Header->FecParity, Scratch);
+		Payload = Scratch;
+	}
+	else
+		Payload += Done;
+	
+	embed_bits(Img, Header, Payload, Start * 8, Count * 8, NumThreads);
+	*Crc = crc32c(*Crc, Payload, Count);
+}
+
+/******************************************************************************/
+//Recover payload bytes [Done, Done + Count) in Chunk, Done being a chunk
+//boundary. The bytes as stored are read from the image, or from the open image
+//file if Img is NULL, repaired and their CRC32C folded into Crc (if not NULL),
+//then only the payload bytes are kept. Chunk must hold the bytes as stored.
+static int extract_chunk(const img24_t *Img, FILE *Image, const dimensions_t *Dimension,
+						 const payload_header_t *Header, uint8_t *Chunk, uint64_t Done, uint64_t Count, uint32_t *Crc,
+						 uint64_t *Repaired, int NumThreads)
+{
+	lsb_format_t	Format = payload_format(Header);
+	uint64_t		Start = stored_offset(Header, Done);
+	uint64_t		Size = stored_offset(Header, Done + Count) - Start;
+	int64_t			Fixed = 0;
+	
+	if(Img != NULL)
+		extract_bits(Img, Header, Chunk, Start * 8, Size * 8, NumThreads);
+	else if(read_slots(Image, Dimension, &Format, PAYLOAD_HEADER_SLOTS +
+					   lsb_format_slots(&Format, PAYLOAD_HEADER_SLOTS, Start * 8), Size * 8, Chunk) < 0)
+		return PAYLOAD_READ_ERROR;
+	
+	if(Header->Flags & PAYLOAD_FEC)
+	{
+		Fixed = fec_decode(Chunk, Size, Header->FecParity);
+		if(Fixed < 0)
+			return PAYLOAD_BAD_FEC;
+	}
+	
+	if(Repaired != NULL)
+		*Repaired += Fixed;
+	if(Crc != NULL)
+		*Crc = crc32c(*Crc, Chunk, Size);
+	
+	if(Header->Flags & PAYLOAD_FEC)
+		fec_compact(Chunk, Size, Header->FecParity);
+	
+	return PAYLOAD_OK;
+}
+
+/******************************************************************************/
+//Bytes that fit in NumSlots channel slots
+static uint64_t stored_capacity(uint64_t NumSlots, const lsb_format_t *Format)
+{
+	if(NumSlots < PAYLOAD_HEADER_SLOTS)
+		return 0;
+	
+	return lsb_format_bits(Format, PAYLOAD_HEADER_SLOTS, NumSlots - PAYLOAD_HEADER_SLOTS) / 8;
+}
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Set or clear the scatter key
+void payload_set_key(const char *Passphrase)
+{
+	ScatterKeySet = (Passphrase != NULL);
+	ScatterKey = (Passphrase != NULL) ? scatter_key(Passphrase) : 0;
+}
+
+/******************************************************************************/
+//Set or clear the error correction
+void payload_set_fec(unsigned Parity)
+{
+	FecParity = Parity;
+}
+
+/******************************************************************************/
+//Max payload size in bytes, the container header takes the first slots
+uint64_t payload_capacity(uint64_t NumSlots, const lsb_format_t *Format)
+{
+	uint64_t Capacity = stored_capacity(NumSlots, Format);
+	
+	return (FecParity > 0) ? fec_capacity(Capacity, FecParity) : Capacity;
+}
+
+/******************************************************************************/
+//Fill a container header
+void payload_make_header(payload_header_t *Header, uint64_t Length, const lsb_format_t *Format)
+{
+	memset(Header, 0, sizeof(payload_header_t));
+	memcpy(Header->Signature, PAYLOAD_SIGNATURE, PAYLOAD_SIGNATURE_SIZE);
+	Header->Version = PAYLOAD_VERSION;
+	Header->Length = Length;
+	Header->Bits = Format->Bits;
+	Header->Channels = Format->Channels;
+	Header->OriginalLength = Length;
+	if(ScatterKeySet)
+	{
+		Header->Flags |= PAYLOAD_SCATTERED;
+		Header->KeyCheck = scatter_key_check(ScatterKey);
+	}
+	if(FecParity > 0)
+	{
+		Header->Flags |= PAYLOAD_FEC;
+		Header->FecParity = FecParity;
+	}
+	payload_seal_header(Header);
+}
+
+/******************************************************************************/
+//Update the checksum of a header
+void payload_seal_header(payload_header_t *Header)
+{
+	Header->Checksum = fnv1a((const uint8_t *)Header, offsetof(payload_header_t, Checksum));
+}
+
+/******************************************************************************/
+//Record the CRC32C of the payload bytes in a header
+void payload_set_crc(payload_header_t *Header, uint32_t Crc)
+{
+	Header->Flags |= PAYLOAD_HAS_CRC;
+	Header->PayloadCrc = Crc;
+	payload_seal_header(Header);
+}
+
+/******************************************************************************/
+//Compare the CRC32C of the payload bytes with the one in the header
+int payload_check_crc(const payload_header_t *Header, uint32_t Crc)
+{
+	if((Header->Flags & PAYLOAD_HAS_CRC) && (Header->PayloadCrc != Crc))
+		return PAYLOAD_BAD_CRC;
+	
+	return PAYLOAD_OK;
+}
+
+/******************************************************************************/
+//Density format recorded in a container header
+lsb_format_t payload_format(const payload_header_t *Header)
+{
+	lsb_format_t Format = {1, LSB_ALL_CHANNELS};
+	
+	if(Header->Version >= 2)
+	{
+		Format.Bits = Header->Bits;
+		Format.Channels = Header->Channels;
+	}
+	
+	return Format;
+}
+
+/******************************************************************************/
+//Bytes stored for the payload
+uint64_t payload_stored_length(const payload_header_t *Header)
+{
+	return stored_offset(Header, Header->Length);
+}
+
+/******************************************************************************/
+//Check the stored payload against the image size
+int payload_fits(const payload_header_t *Header, uint64_t NumSlots)
+{
+	lsb_format_t Format = payload_format(Header);
+	
+	return payload_stored_length(Header) <= stored_capacity(NumSlots, &Format);
+}
+
+/******************************************************************************/
+//First channel slot after the payload
+uint64_t payload_end_slot(const payload_header_t *Header)
+{
+	lsb_format_t Format = payload_format(Header);
+	
+	if(Header->Flags & PAYLOAD_SCATTERED)
+		return UINT64_MAX;
+	
+	return PAYLOAD_HEADER_SLOTS + lsb_format_slots(&Format, PAYLOAD_HEADER_SLOTS, payload_stored_length(Header) * 8);
+}
+
+/******************************************************************************/
+//Check the key of a scattered payload
+int payload_check_key(const payload_header_t *Header)
+{
+	if(!(Header->Flags & PAYLOAD_SCATTERED))
+		return PAYLOAD_OK;
+	
+	if(!ScatterKeySet || (Header->KeyCheck != scatter_key_check(ScatterKey)))
+		return PAYLOAD_BAD_KEY;
+	
+	return PAYLOAD_OK;
+}
+
+/******************************************************************************/
+//Validate a container header
+int payload_check_header(const payload_header_t *Header)
+{
+	if(memcmp(Header->Signature, PAYLOAD_SIGNATURE, PAYLOAD_SIGNATURE_SIZE) != 0)
+		return PAYLOAD_NO_SIGNATURE;
+	
+	if(Header->Checksum != fnv1a((const uint8_t *)Header, offsetof(payload_header_t, Checksum)))
+		return PAYLOAD_BAD_CHECKSUM;
+	
+	if((Header->Version < 1) || (Header->Version > PAYLOAD_VERSION))
+		return PAYLOAD_BAD_VERSION;
+	
+	if((Header->Version >= 2) && !lsb_format_valid(&(lsb_format_t){Header->Bits, Header->Channels}))
+		return PAYLOAD_BAD_VERSION;
+	
+	if(Header->Flags & ~PAYLOAD_KNOWN_FLAGS)
+		return PAYLOAD_BAD_VERSION;
+	
+	if((Header->Flags & PAYLOAD_FEC) && ((Header->FecParity == 0) || (Header->FecParity > FEC_MAX_PARITY)))
+		return PAYLOAD_BAD_VERSION;
+	
+	return PAYLOAD_OK;
+}
+
+/******************************************************************************/
+//Read and validate the container header of an image
+int payload_read_header(const img24_t *Img, payload_header_t *Header)
+{
+	int Result;
+	
+	memset(Header, 0, sizeof(payload_header_t));
+	
+	if(LSB_IMG_SLOTS(Img) < PAYLOAD_HEADER_SLOTS)
+		return PAYLOAD_NO_SIGNATURE;
+	
+	//Signature first, so images without payload are rejected after 10 bytes
+	lsb_extract_img(Img, (uint8_t *)Header, 0, PAYLOAD_SIGNATURE_SIZE * 8);
+	if(memcmp(Header->Signature, PAYLOAD_SIGNATURE, PAYLOAD_SIGNATURE_SIZE) != 0)
+		return PAYLOAD_NO_SIGNATURE;
+	
+	lsb_extract_img(Img, (uint8_t *)Header + PAYLOAD_SIGNATURE_SIZE, PAYLOAD_SIGNATURE_SIZE * 8,
+					PAYLOAD_HEADER_SLOTS - PAYLOAD_SIGNATURE_SIZE * 8);
+	
+	Result = payload_check_header(Header);
+	
+	return (Result == PAYLOAD_OK) ? payload_check_key(Header) : Result;
+}
+
+/******************************************************************************/
+//Store the container header and the payload in the image
+void payload_embed_img(img24_t *Img, payload_header_t *Header, const uint8_t *Payload, int NumThreads)
+{
+	uint64_t	ChunkSize = chunk_length(Header);
+	uint64_t	Count;
+	uint8_t		*Scratch = NULL;
+	uint32_t	Crc = 0;
+	
+	if(Header->Flags & PAYLOAD_FEC)
+	{
+		Scratch = malloc(stored_offset(Header, (Header->Length < ChunkSize) ? Header->Length : ChunkSize) + 1);
+		if(Scratch == NULL)
+		{
+			printf("Error: could not allocate memory for error correction\n\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	//Payload first, then the container header that records its CRC
+	for(uint64_t Done = 0; Done < Header->Length; Done += Count)
+	{
+		Count = (Header->Length - Done < ChunkSize) ? (Header->Length - Done) : ChunkSize;
+		embed_chunk(Img, Header, Payload, Done, Count, Scratch, &Crc, NumThreads);
+	}
+	
+	free(Scratch);
+	
+	payload_set_crc(Header, Crc);
+	lsb_embed_img(Img, (const uint8_t *)Header, 0, PAYLOAD_HEADER_SLOTS);
+}
+
+/******************************************************************************/
+//Replace the payload, storing only the bytes that changed
+int64_t payload_update_img(img24_t *Img, const payload_header_t *OldHeader, payload_header_t *NewHeader,
+						   const uint8_t *Payload, int NumThreads)
+{
+	lsb_format_t	Format = payload_format(NewHeader);
+	uint64_t		OldLength = payload_stored_length(OldHeader);
+	uint64_t		NewLength = payload_stored_length(NewHeader);
+	uint64_t		Common = (OldLength < NewLength) ? OldLength : NewLength;
+	uint64_t		ChunkSize = (uint64_t)EXTRACT_CHUNK * Format.Bits;
+	uint64_t		Stored = 0;
+	uint64_t		Done;
+	uint64_t		Count;
+	uint64_t		First;
+	uint64_t		Last;
+	uint32_t		Crc = 0;
+	uint8_t			*Chunk;
+	uint8_t			*Encoded = NULL;
+	
+	//Bytes as stored are compared, parity included
+	if(NewHeader->Flags & PAYLOAD_FEC)
+	{
+		Encoded = malloc(NewLength + 1);
+		if(Encoded == NULL)
+			return -1;
+		fec_encode(Payload, NewHeader->Length, NewHeader->FecParity, Encoded);
+		Payload = Encoded;
+	}
+	
+	Chunk = malloc((Common < ChunkSize) ? Common + 1 : ChunkSize);
+	if(Chunk == NULL)
+	{
+		free(Encoded);
+		return -1;
+	}
+	
+	//Old bytes are read back a chunk at a time and compared with the new ones
+	for(Done = 0; Done < Common; Done += Count)
+	{
+		Count = (Common - Done < ChunkSize) ? (Common - Done) : ChunkSize;
+		
+		extract_bits(Img, NewHeader, Chunk, Done * 8, Count * 8, NumThreads);
+		Crc = crc32c(Crc, Payload + Done, Count);
+		
+		for(uint64_t i = 0; i < Count;)
+		{
+			if(Chunk[i] == Payload[Done + i])
+			{
+				i++;
+				continue;
+			}
+			
+			//Run of changed bytes, up to UPDATE_GAP equal bytes in a row
+			First = i;
+			Last = i + 1;
+			for(i = Last; (i < Count) && (i - Last < UPDATE_GAP); i++)
+			{
+				if(Chunk[i] != Payload[Done + i])
+					Last = i + 1;
+			}
+			
+			Stored += store_bytes(Img, NewHeader, Payload, Done + First, Done + Last, NumThreads);
+		}
+	}
+	
+	free(Chunk);
+	
+	//Appended bytes have nothing to be compared with
+	if(NewLength > Common)
+	{
+		Stored += store_bytes(Img, NewHeader, Payload, Common, NewLength, NumThreads);
+		Crc = crc32c(Crc, Payload + Common, NewLength - Common);
+	}
+	
+	free(Encoded);
+	
+	payload_set_crc(NewHeader, Crc);
+	lsb_embed_img(Img, (const uint8_t *)NewHeader, 0, PAYLOAD_HEADER_SLOTS);
+	
+	return Stored;
+}
+
+/******************************************************************************/
+//Recover the payload from the image
+int payload_extract_img(const img24_t *Img, const payload_header_t *Header, uint8_t *Payload, int NumThreads)
+{
+	uint64_t	ChunkSize = chunk_length(Header);
+	uint64_t	Count;
+	uint8_t		*Chunk = NULL;
+	uint32_t	Crc = 0;
+	int			Result = PAYLOAD_OK;
+	
+	//Without parity bytes the payload is extracted in place
+	if(Header->Flags & PAYLOAD_FEC)
+	{
+		Chunk = malloc(stored_offset(Header, (Header->Length < ChunkSize) ? Header->Length : ChunkSize) + 1);
+		if(Chunk == NULL)
+			return PAYLOAD_READ_ERROR;
+	}
+	
+	for(uint64_t Done = 0; (Done < Header->Length) && (Result == PAYLOAD_OK); Done += Count)
+	{
+		Count = (Header->Length - Done < ChunkSize) ? (Header->Length - Done) : ChunkSize;
+		
+		Result = extract_chunk(Img, NULL, NULL, Header, (Chunk != NULL) ? Chunk : Payload + Done, Done, Count, &Crc,
+							   NULL, NumThreads);
+		if(Chunk != NULL)
+			memcpy(Payload + Done, Chunk, Count);
+	}
+	
+	free(Chunk);
+	
+	return (Result == PAYLOAD_OK) ? payload_check_crc(Header, Crc) : Result;
+}
+
+/******************************************************************************/
+//Recover the payload chunk by chunk and write it to a file
+int payload_extract_file(const img24_t *Img, const payload_header_t *Header, FILE *Output, int NumThreads,
+						 uint64_t *Repaired)
+{
+	decompress_stream_t		Stream;
+	uint64_t				ChunkSize = chunk_length(Header);
+	uint64_t				Done;
+	uint64_t				Count;
+	uint64_t				Fixed = 0;
+	uint8_t					*Chunk;
+	uint32_t				Crc = 0;
+	int						Result = PAYLOAD_OK;
+	
+	Chunk = malloc(stored_offset(Header, (Header->Length < ChunkSize) ? Header->Length : ChunkSize) + 1);
+	if(Chunk == NULL)
+		return PAYLOAD_READ_ERROR;
+	
+	if((Header->Flags & PAYLOAD_COMPRESSED) && (decompress_init(&Stream) != 0))
+	{
+		free(Chunk);
+		return PAYLOAD_READ_ERROR;
+	}
+	
+	//With no output file everything is still decoded, but nothing is written
+	if((Header->Flags & PAYLOAD_COMPRESSED) && (Output == NULL))
+		Stream.Last = 0;
+	
+	for(Done = 0; (Done < Header->Length) && (Result == PAYLOAD_OK); Done += Count)
+	{
+		Count = (Header->Length - Done < ChunkSize) ? (Header->Length - Done) : ChunkSize;
+		
+		Result = extract_chunk(Img, NULL, NULL, Header, Chunk, Done, Count, &Crc, &Fixed, NumThreads);
+		if(Result != PAYLOAD_OK)
+			break;
+		
+		if(Header->Flags & PAYLOAD_COMPRESSED)
+		{
+			if(decompress_feed(&Stream, Chunk, Count, Output) != 0)
+				Result = PAYLOAD_READ_ERROR;
+		}
+		else if((Output != NULL) && (fwrite(Chunk, 1, Count, Output) != Count))
+			Result = PAYLOAD_READ_ERROR;
+	}
+	
+	if(Result == PAYLOAD_OK)
+		Result = payload_check_crc(Header, Crc);
+	
+	if(Header->Flags & PAYLOAD_COMPRESSED)
+	{
+		if((decompress_end(&Stream) != 0) || (Stream.Total != Header->OriginalLength))
+		{
+			if(Result == PAYLOAD_OK)
+				Result = PAYLOAD_READ_ERROR;
+		}
+	}
+	
+	free(Chunk);
+	
+	if(Repaired != NULL)
+		*Repaired = Fixed;
+	
+	return Result;
+}
+
+/******************************************************************************/
+//Read and validate the container header of an image file
+int payload_probe(const char *Filename, payload_header_t *Header)
+{
+	dimensions_t	Dimension;
+	FILE			*Image;
+	int				Result;
+	
+	Image = fopen(Filename, "rb");
+	if(Image == NULL)
+	{
+		memset(Header, 0, sizeof(payload_header_t));
+		return PAYLOAD_NOT_CARRIER;
+	}
+	
+	Result = probe_file(Image, &Dimension, Header);
+	fclose(Image);
+	
+	return Result;
+}
+
+/******************************************************************************/
+//Recover a byte range of the payload reading only the rows that hold it
+int payload_extract_range(const char *Filename, uint64_t Offset, uint64_t Length, FILE *Output,
+						  payload_header_t *Header)
+{
+	dimensions_t			Dimension;
+	lsb_format_t			Format;
+	decompress_stream_t		Stream;
+	FILE					*Image;
+	img24_t					*Img = NULL;
+	uint8_t					*Chunk = NULL;
+	uint64_t				ChunkSize;
+	uint64_t				PayloadSize;
+	uint64_t				Start;
+	uint64_t				End;
+	uint64_t				Count;
+	uint64_t				Skip;
+	uint64_t				Align;
+	uint64_t				Size;
+	uint32_t				Crc = 0;
+	int						Checked;
+	int						Compressed;
+	int						Decoding = 0;
+	int						Result;
+	
+	Image = fopen(Filename, "rb");
+	if(Image == NULL)
+	{
+		memset(Header, 0, sizeof(payload_header_t));
+		return PAYLOAD_NOT_CARRIER;
+	}
+	
+	Result = probe_file(Image, &Dimension, Header);
+	Format = payload_format(Header);
+	Compressed = (Header->Flags & PAYLOAD_COMPRESSED) != 0;
+	PayloadSize = Compressed ? Header->OriginalLength : Header->Length;
+	
+	if((Result == PAYLOAD_OK) && !payload_fits(Header, LSB_IMG_SLOTS(&Dimension)))
+		Result = PAYLOAD_READ_ERROR;
+	if((Result == PAYLOAD_OK) && (Offset > PayloadSize))
+		Result = PAYLOAD_BAD_RANGE;
+	if(Result == PAYLOAD_OK)
+		Result = payload_check_key(Header);
+	
+	//Scattered fields are anywhere in the image, which is then mapped so only
+	//the pages holding them are read
+	if((Result == PAYLOAD_OK) && (Header->Flags & PAYLOAD_SCATTERED) && (try_map_BMP(Filename, 0, &Img) != BMP_OK))
+		Result = PAYLOAD_READ_ERROR;
+	
+	if(Result != PAYLOAD_OK)
+	{
+		fclose(Image);
+		return Result;
+	}
+	
+	if(Length > PayloadSize - Offset)
+		Length = PayloadSize - Offset;
+	
+	//Payload bytes to read. A stored byte may begin inside a channel field, so
+	//the first one is moved back to a field boundary and the extra bytes are
+	//skipped. With error correction whole groups are read, as a codeword spans
+	//its group. Compressed data is only decodable from its first block on.
+	Align = (Header->Flags & PAYLOAD_FEC) ? FEC_GROUP_DATA(Header->FecParity) : Format.Bits;
+	if(Compressed)
+	{
+		Start = 0;
+		End = Header->Length;
+	}
+	else
+	{
+		Start = Offset - Offset % Align;
+		End = Offset + Length;
+		if(Header->Flags & PAYLOAD_FEC)
+		{
+			End += (Align - End % Align) % Align;
+			if(End > Header->Length)
+				End = Header->Length;
+		}
+	}
+	Skip = Compressed ? 0 : Offset - Start;
+	
+	//The CRC can only be checked when every stored byte is read
+	Checked = (Start == 0);
+	
+	ChunkSize = chunk_length(Header);
+	if(ChunkSize > End - Start)
+		ChunkSize = End - Start;
+	
+	if((ChunkSize > 0) && ((Chunk = malloc(stored_offset(Header, ChunkSize))) == NULL))
+		Result = PAYLOAD_READ_ERROR;
+	
+	if(Compressed && (Result == PAYLOAD_OK))
+	{
+		Decoding = (decompress_init(&Stream) == 0);
+		if(!Decoding)
+			Result = PAYLOAD_READ_ERROR;
+		
+		Stream.First = Offset;
+		Stream.Last = Offset + Length;
+	}
+	
+	//A compressed payload stops being read once the range is decoded
+	for(; (Result == PAYLOAD_OK) && (Start < End) && (!Compressed || (Stream.Total < Offset + Length)); Start += Count)
+	{
+		Count = (End - Start < ChunkSize) ? (End - Start) : ChunkSize;
+		
+		Result = extract_chunk(Img, Image, &Dimension, Header, Chunk, Start, Count, Checked ? &Crc : NULL, NULL, 1);
+		if(Result != PAYLOAD_OK)
+			break;
+		
+		if(Compressed)
+		{
+			if(decompress_feed(&Stream, Chunk, Count, Output) != 0)
+				Result = PAYLOAD_READ_ERROR;
+		}
+		else
+		{
+			//Whole groups may run past the range
+			Size = ((Start + Count < Offset + Length) ? Count : Offset + Length - Start) - Skip;
+			if(fwrite(Chunk + Skip, 1, Size, Output) != Size)
+				Result = PAYLOAD_READ_ERROR;
+		}
+		
+		Skip = 0;
+	}
+	
+	if(Decoding)
+	{
+		if((Result == PAYLOAD_OK) && (Stream.Total < Offset + Length))
+			Result = PAYLOAD_READ_ERROR;
+		decompress_end(&Stream);
+	}
+	
+	if(Checked && (Start >= Header->Length) && (Result == PAYLOAD_OK))
+		Result = payload_check_crc(Header, Crc);
+	
+	free(Chunk);
+	fclose(Image);
+	if(Img != NULL)
+		free_img(Img);
+	
+	return Result;
+}
+
+/******************************************************************************/
+//Message describing a payload result
+const char *payload_error(int Result)
+{
+	switch(Result)
+	{
+		case PAYLOAD_OK :
+			return "valid payload";
+		case PAYLOAD_NO_SIGNATURE :
+			return "image does not carry a payload";
+		case PAYLOAD_BAD_VERSION :
+			return "payload was written by an unsupported format version or density";
+		case PAYLOAD_BAD_CHECKSUM :
+			return "payload header is damaged (checksum mismatch)";
+		case PAYLOAD_NOT_CARRIER :
+			return "file is not a BMP image in a pixel format that can carry a payload";
+		case PAYLOAD_BAD_RANGE :
+			return "range starts past the end of the payload";
+		case PAYLOAD_READ_ERROR :
+			return "payload could not be read or written, or is damaged";
+		case PAYLOAD_BAD_KEY :
+			return "payload is scattered with a key, the one given (--key) is missing or wrong";
+		case PAYLOAD_BAD_CRC :
+			return "payload is damaged (CRC32C mismatch)";
+		case PAYLOAD_BAD_FEC :
+			return "payload has more damage than its error correction can repair";
+		default :
+			return "unknown error";
+	}
+}
@@ -0,0 +1,187 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the payload container stored in the image          *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __PAYLOAD_H__
+#define __PAYLOAD_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//The container header is stored in the first channel slots of the image (one
+//bit per slot) and the payload bytes follow right after it, with the density
+//format recorded in the header. With error correction the payload bytes are
+//stored with their parity bytes (fec.h), which Length does not count.
+
+#define PAYLOAD_SIGNATURE		"stegVHAHSS"
+#define PAYLOAD_SIGNATURE_SIZE	10
+#define PAYLOAD_VERSION			2		//Version 1 has no density format (1 bit, all channels)
+
+//Container header flags
+#define PAYLOAD_COMPRESSED		0x01	//Payload bytes are LZ compressed (compress.h)
+#define PAYLOAD_SCATTERED		0x02	//Payload fields are in keyed order (scatter.h)
+#define PAYLOAD_HAS_CRC			0x04	//PayloadCrc holds the CRC32C of the payload bytes (crc.h)
+#define PAYLOAD_FEC				0x08	//Payload bytes are stored with Reed-Solomon parity (fec.h)
+#define PAYLOAD_KNOWN_FLAGS		(PAYLOAD_COMPRESSED | PAYLOAD_SCATTERED | PAYLOAD_HAS_CRC | PAYLOAD_FEC)
+
+//Size of the container header in bytes and in channel slots
+#define PAYLOAD_HEADER_SIZE		64
+#define PAYLOAD_HEADER_SLOTS	(PAYLOAD_HEADER_SIZE * 8)
+
+//Results of payload_check_header(), payload_check_key() and the extract functions
+#define PAYLOAD_OK				0
+#define PAYLOAD_NO_SIGNATURE	-1		//Image does not carry a payload
+#define PAYLOAD_BAD_VERSION		-2		//Written by a newer version of the program
+#define PAYLOAD_BAD_CHECKSUM	-3		//Header is damaged
+#define PAYLOAD_NOT_CARRIER		-4		//File is not an image that can carry a payload
+#define PAYLOAD_BAD_RANGE		-5		//Byte range outside the payload
+#define PAYLOAD_READ_ERROR		-6		//Payload can not be read or written, or is damaged
+#define PAYLOAD_BAD_KEY			-7		//Payload is scattered with another key, or none given
+#define PAYLOAD_BAD_CRC			-8		//Payload bytes do not match their CRC32C
+#define PAYLOAD_BAD_FEC			-9		//Payload has more damage than its parity repairs
+
+/*******************************************************************************
+ *                                   STRUCTURES                                *
+ *******************************************************************************/
+
+#pragma pack(push, 1)
+
+//Container header (64 bytes, little endian)
+struct payload_header
+{
+	char Signature[PAYLOAD_SIGNATURE_SIZE];	//PAYLOAD_SIGNATURE, no terminator
+	uint8_t Version;					//Format version (PAYLOAD_VERSION)
+	uint8_t Flags;						//Payload options (PAYLOAD_COMPRESSED | ...)
+	uint64_t Length;					//Payload size in bytes
+	uint8_t Bits;						//Payload bits per channel
+	uint8_t Channels;					//Channels carrying payload (LSB_BLUE | ...)
+	uint64_t OriginalLength;			//Payload size before compression
+	uint16_t ShardIndex;				//Position of this shard in the set (from 0)
+	uint16_t ShardCount;				//Shards in the set, 0 if not sharded
+	uint64_t ShardOffset;				//Offset of this shard in the whole payload
+	uint32_t KeyCheck;					//scatter_key_check() of the key, if scattered
+	uint32_t PayloadCrc;				//CRC32C of the payload bytes as stored, if PAYLOAD_HAS_CRC
+	uint8_t FecParity;					//Parity bytes per codeword, if PAYLOAD_FEC
+	uint8_t Reserved[9];				//Must be zero
+	uint32_t Checksum;					//FNV-1a of all previous header bytes
+};
+#pragma pack(pop)
+
+typedef struct payload_header		payload_header_t;
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Scatter the payloads attached from now on with the key of a passphrase, which
+//scattered payloads also need to be read. NULL goes back to sequential order.
+void payload_set_key(const char *Passphrase);
+//------------------------------------------------------------------------------
+//Store the payloads attached from now on with Parity Reed-Solomon parity bytes
+//per codeword (2 to FEC_MAX_PARITY), 0 for none
+void payload_set_fec(unsigned Parity);
+//------------------------------------------------------------------------------
+//Max payload size in bytes for an image with NumSlots channel slots, with the
+//error correction set by payload_set_fec()
+uint64_t payload_capacity(uint64_t NumSlots, const lsb_format_t *Format);
+//------------------------------------------------------------------------------
+//Fill a container header for a payload of Length bytes stored with Format
+void payload_make_header(payload_header_t *Header, uint64_t Length, const lsb_format_t *Format);
+//------------------------------------------------------------------------------
+//Update the checksum after changing fields of a header made by
+//payload_make_header()
+void payload_seal_header(payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Record the CRC32C of the payload bytes as stored (crc32c() from 0) in a header
+//and seal it
+void payload_set_crc(payload_header_t *Header, uint32_t Crc);
+//------------------------------------------------------------------------------
+//Compare the CRC32C of the payload bytes read back with the one recorded in the
+//header, returns PAYLOAD_OK or PAYLOAD_BAD_CRC. Headers with no CRC recorded
+//pass.
+int payload_check_crc(const payload_header_t *Header, uint32_t Crc);
+//------------------------------------------------------------------------------
+//Density format recorded in a valid container header
+lsb_format_t payload_format(const payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Bytes stored in the image for the payload described by a valid container
+//header, parity bytes included
+uint64_t payload_stored_length(const payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Non zero if the payload described by a valid container header fits in an
+//image with NumSlots channel slots
+int payload_fits(const payload_header_t *Header, uint64_t NumSlots);
+//------------------------------------------------------------------------------
+//First channel slot after the payload described by a valid container header,
+//UINT64_MAX if the payload is scattered over the whole image
+uint64_t payload_end_slot(const payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Validate a container header, returns PAYLOAD_OK or one of the error results
+int payload_check_header(const payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Check that a scattered payload can be read with the key set, returns
+//PAYLOAD_OK or PAYLOAD_BAD_KEY
+int payload_check_key(const payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Read and validate the container header of an image, and the key if the
+//payload is scattered. Only the signature is decoded from images that do not
+//carry a payload.
+int payload_read_header(const img24_t *Img, payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Store the payload and then the container header that describes it in the
+//image. The CRC32C of the payload is recorded in the header on the way.
+void payload_embed_img(img24_t *Img, payload_header_t *Header, const uint8_t *Payload, int NumThreads);
+//------------------------------------------------------------------------------
+//Replace the payload described by OldHeader with the one of NewHeader, stored
+//with the same density. Old bytes are read back and only the runs that differ
+//are stored, bytes past the old payload are stored as they are, then the new
+//header with the CRC32C of the new payload. Returns the number of payload
+//bytes stored, or -1 if memory runs out.
+int64_t payload_update_img(img24_t *Img, const payload_header_t *OldHeader, payload_header_t *NewHeader,
+						   const uint8_t *Payload, int NumThreads);
+//------------------------------------------------------------------------------
+//Recover the payload described by a valid container header from the image,
+//repairing damaged bytes if it has error correction. Returns PAYLOAD_OK,
+//PAYLOAD_BAD_CRC, PAYLOAD_BAD_FEC, or PAYLOAD_READ_ERROR if memory runs out.
+int payload_extract_img(const img24_t *Img, const payload_header_t *Header, uint8_t *Payload, int NumThreads);
+//------------------------------------------------------------------------------
+//Recover the payload described by a valid container header from the image and
+//write it to a file, a chunk at a time. Compressed payloads are decompressed
+//on the way and damaged bytes repaired with the error correction, if any, the
+//number of bytes repaired going to Repaired (may be NULL). With a NULL Output
+//the payload is only read and checked. Returns PAYLOAD_OK, PAYLOAD_BAD_CRC,
+//PAYLOAD_BAD_FEC, or PAYLOAD_READ_ERROR if the file can not be written or the
+//compressed data is corrupt.
+int payload_extract_file(const img24_t *Img, const payload_header_t *Header, FILE *Output, int NumThreads,
+						 uint64_t *Repaired);
+//------------------------------------------------------------------------------
+//Read and validate the container header of an image file, reading only the
+//BMP headers and the few pixel bytes that hold the container header
+int payload_probe(const char *Filename, payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Recover bytes [Offset, Offset + Length) of the payload of an image file,
+//Length being cut at the end of the payload. Only the pixel rows holding them
+//and the container header are read, so the time taken does not depend on the
+//image size. A compressed payload is decoded from its start up to the end of
+//the range, and with error correction the groups holding the range are read
+//and repaired. The CRC32C is checked only if every stored byte is read. Returns
+//PAYLOAD_OK or an error result.
+int payload_extract_range(const char *Filename, uint64_t Offset, uint64_t Length, FILE *Output,
+						  payload_header_t *Header);
+//------------------------------------------------------------------------------
+//Message describing a payload_check_header() or extract result
+const char *payload_error(int Result);
+
+
+#endif
@@ -0,0 +1,547 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the capacity planner: assigns payloads to the carriers of a	*
+ * corpus and writes the batch manifest doing it								*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+#include "payload.h"
+#include "compress.h"
+#include "shard.h"
+#include "plan.h"
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//What a scanned file turned out to be
+#define CARRIER_NONE		0			//Not an image that can carry a payload
+#define CARRIER_FREE		1
+#define CARRIER_BUSY		2			//Already holds a payload
+#define CARRIER_PAYLOAD		3			//One of the payloads being placed
+
+//One file of the corpus
+struct plan_carrier
+{
+	char *Path;
+	dev_t Device;						//To recognise payloads inside the corpus
+	ino_t Inode;
+	int Status;
+	uint64_t RowSlots;					//Channel slots per pixel row
+	uint64_t Stride;					//Bytes per pixel row in the file
+	uint64_t Capacity;					//Payload bytes, 0 until scanned
+	int Owner;							//Payload using the carrier, -1 if none
+};
+
+//One payload to place
+struct plan_payload
+{
+	const char *Path;
+	uint64_t Size;
+	int Readable;
+	int *Carrier;						//Carriers given to it, in shard order
+	int NumCarriers;
+};
+
+//Shared by the scanning workers
+struct plan_state
+{
+	struct plan_carrier *Carrier;
+	int NumCarriers;
+	int CarrierCapacity;
+	int NumSkipped;						//Paths the manifest can not hold
+	const lsb_format_t *Format;
+	int Next;							//Next carrier to be taken by a worker
+	pthread_mutex_t Lock;
+};
+
+//Payloads being sorted by compare_payloads()
+static const struct plan_payload *SortPayload;
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Add a file, or every file under a directory, to the carrier list. Returns -1
+//if memory runs out.
+static int collect_path(struct plan_state *State, const char *Path)
+{
+	struct stat				PathStat;
+	DIR						*Directory;
+	struct dirent			*Entry;
+	char					*EntryPath;
+	struct plan_carrier		*NewCarrier;
+	int						Result = 0;
+	
+	if(stat(Path, &PathStat) != 0)
+	{
+		printf("%s: could not be read\n", Path);
+		return 0;
+	}
+	
+	if(S_ISDIR(PathStat.st_mode))
+	{
+		Directory = opendir(Path);
+		if(Directory == NULL)
+		{
+			printf("%s: could not be read\n", Path);
+			return 0;
+		}
+		
+		while((Result == 0) && ((Entry = readdir(Directory)) != NULL))
+		{
+			if((strcmp(Entry->d_name, ".") == 0) || (strcmp(Entry->d_name, "..") == 0))
+				continue;
+			
+			EntryPath = malloc(strlen(Path) + strlen(Entry->d_name) + 2);
+			if(EntryPath == NULL)
+			{
+				Result = -1;
+				break;
+			}
+			
+			sprintf(EntryPath, "%s/%s", Path, Entry->d_name);
+			Result = collect_path(State, EntryPath);
+			free(EntryPath);
+		}
+		
+		closedir(Directory);
+		return Result;
+	}
+	
+	if(!S_ISREG(PathStat.st_mode))
+		return 0;
+	
+	//Manifest fields are split on blanks and '#' starts a comment
+	if(strpbrk(Path, " \t\r\n#") != NULL)
+	{
+		State->NumSkipped++;
+		return 0;
+	}
+	
+	if(State->NumCarriers == State->CarrierCapacity)
+	{
+		State->CarrierCapacity = (State->CarrierCapacity > 0) ? State->CarrierCapacity * 2 : 64;
+		NewCarrier = realloc(State->Carrier, State->CarrierCapacity * sizeof(struct plan_carrier));
+		if(NewCarrier == NULL)
+			return -1;
+		State->Carrier = NewCarrier;
+	}
+	
+	memset(&State->Carrier[State->NumCarriers], 0, sizeof(struct plan_carrier));
+	State->Carrier[State->NumCarriers].Path = strdup(Path);
+	State->Carrier[State->NumCarriers].Device = PathStat.st_dev;
+	State->Carrier[State->NumCarriers].Inode = PathStat.st_ino;
+	State->Carrier[State->NumCarriers].Owner = -1;
+	if(State->Carrier[State->NumCarriers].Path == NULL)
+		return -1;
+	
+	State->NumCarriers++;
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Read the headers of one carrier: the BMP headers for its capacity and the
+//first pixels for a container signature
+static void scan_carrier(struct plan_carrier *Carrier, const lsb_format_t *Format)
+{
+	payload_header_t	Header;
+	dimensions_t		Dimension;
+	FILE				*Image;
+	int					Result;
+	
+	Result = payload_probe(Carrier->Path, &Header);
+	if(Result == PAYLOAD_NOT_CARRIER)
+	{
+		Carrier->Status = CARRIER_NONE;
+		return;
+	}
+	if(Result != PAYLOAD_NO_SIGNATURE)
+	{
+		Carrier->Status = CARRIER_BUSY;
+		return;
+	}
+	
+	Image = fopen(Carrier->Path, "rb");
+	if(Image == NULL)
+	{
+		Carrier->Status = CARRIER_NONE;
+		return;
+	}
+	
+	Result = read_dimensions_BMP(Image, &Dimension);
+	fclose(Image);
+	if(Result != BMP_OK)
+	{
+		Carrier->Status = CARRIER_NONE;
+		return;
+	}
+	
+	Carrier->RowSlots = LSB_ROW_SLOTS(&Dimension);
+	Carrier->Stride = Dimension.Stride;
+	Carrier->Capacity = payload_capacity(LSB_IMG_SLOTS(&Dimension), Format);
+	if(!lsb_format_fits_layout(Format, &Dimension.Layout))
+		Carrier->Capacity = 0;
+	Carrier->Status = (Carrier->Capacity > 0) ? CARRIER_FREE : CARRIER_NONE;
+}
+
+/******************************************************************************/
+//Scanning worker: takes the next carrier until all are scanned
+static void *scan_worker(void *Arg)
+{
+	struct plan_state	*State = Arg;
+	int					Index;
+	
+	while(1)
+	{
+		pthread_mutex_lock(&State->Lock);
+		Index = State->Next++;
+		pthread_mutex_unlock(&State->Lock);
+		
+		if(Index >= State->NumCarriers)
+			break;
+		
+		if(State->Carrier[Index].Status != CARRIER_PAYLOAD)
+			scan_carrier(&State->Carrier[Index], State->Format);
+	}
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Free carriers first, by capacity, then by path so plans are reproducible
+static int compare_carriers(const void *A, const void *B)
+{
+	const struct plan_carrier	*CarrierA = A;
+	const struct plan_carrier	*CarrierB = B;
+	
+	if((CarrierA->Status == CARRIER_FREE) != (CarrierB->Status == CARRIER_FREE))
+		return (CarrierA->Status == CARRIER_FREE) ? -1 : 1;
+	if(CarrierA->Capacity != CarrierB->Capacity)
+		return (CarrierA->Capacity < CarrierB->Capacity) ? -1 : 1;
+	
+	return strcmp(CarrierA->Path, CarrierB->Path);
+}
+
+/******************************************************************************/
+//Bigger payloads are placed first, while the big carriers are still free
+static int compare_payloads(const void *A, const void *B)
+{
+	uint64_t	SizeA = SortPayload[*(const int *)A].Size;
+	uint64_t	SizeB = SortPayload[*(const int *)B].Size;
+	
+	if(SizeA != SizeB)
+		return (SizeA > SizeB) ? -1 : 1;
+	
+	return *(const int *)A - *(const int *)B;
+}
+
+/******************************************************************************/
+//Bytes of the carrier rewritten when Length payload bytes are attached in
+//place: every pixel row from the bottom one to the last one holding payload
+static uint64_t rewritten_bytes(const struct plan_carrier *Carrier, uint64_t Length, const lsb_format_t *Format)
+{
+	uint64_t	EndSlot;
+	
+	EndSlot = PAYLOAD_HEADER_SLOTS + lsb_format_slots(Format, PAYLOAD_HEADER_SLOTS, Length * 8);
+	
+	return ((EndSlot - 1) / Carrier->RowSlots + 1) * Carrier->Stride;
+}
+
+/******************************************************************************/
+//Give the payload the carriers it needs. Carriers are sorted by capacity and
+//the free ones come first (NumFree of them). While no free carrier holds what
+//is left the biggest one is taken, then the smallest one that holds the rest.
+//A payload that fits one carrier so gets the smallest that fits, one that does
+//not gets the fewest carriers. Bytes rewritten are set by the payload size up
+//to the last pixel row, so the image count is what the choice minimises.
+//Returns -1 if there is not enough free capacity.
+static int place_payload(struct plan_payload *Payload, int PayloadIndex, struct plan_carrier *Carrier, int NumFree,
+						 uint8_t Compress, uint64_t *Rewritten, const lsb_format_t *Format)
+{
+	uint64_t	Remaining;
+	uint64_t	Usable;
+	uint64_t	Stored;
+	int			Chosen;
+	int			First;
+	int			Last;
+	int			Middle;
+	
+	//Compressed data can outgrow the payload by a block header per block, and
+	//every shard may cut one more block and leave a few bytes unused
+	Remaining = Compress ? COMPRESS_BOUND(Payload->Size) : Payload->Size;
+	
+	Payload->Carrier = malloc(((NumFree < SHARD_MAX_COUNT) ? NumFree + 1 : SHARD_MAX_COUNT) * sizeof(int));
+	if(Payload->Carrier == NULL)
+		return -1;
+	
+	do
+	{
+		//Smallest free carrier holding the rest
+		First = 0;
+		Last = NumFree;
+		while(First < Last)
+		{
+			Middle = (First + Last) / 2;
+			Usable = Carrier[Middle].Capacity;
+			if(Compress && (Payload->NumCarriers > 0))
+				Usable = (Usable > 2 * COMPRESS_BLOCK_HEADER) ? Usable - 2 * COMPRESS_BLOCK_HEADER : 0;
+			if(Usable < Remaining)
+				First = Middle + 1;
+			else
+				Last = Middle;
+		}
+		
+		for(Chosen = First; (Chosen < NumFree) && (Carrier[Chosen].Owner >= 0); Chosen++);
+		
+		//None does, the biggest free one then
+		if(Chosen == NumFree)
+			for(Chosen = NumFree - 1; (Chosen >= 0) && (Carrier[Chosen].Owner >= 0); Chosen--);
+		
+		if((Chosen < 0) || (Payload->NumCarriers == SHARD_MAX_COUNT))
+			break;
+		
+		//A payload held whole by its first carrier is not split, so the shard
+		//slack is only taken once it needs more carriers (as in the search)
+		Usable = Carrier[Chosen].Capacity;
+		if(Compress && ((Payload->NumCarriers > 0) || (Usable < Remaining)))
+			Usable = (Usable > 2 * COMPRESS_BLOCK_HEADER) ? Usable - 2 * COMPRESS_BLOCK_HEADER : 0;
+		
+		Carrier[Chosen].Owner = PayloadIndex;
+		Payload->Carrier[Payload->NumCarriers++] = Chosen;
+		Remaining -= (Usable < Remaining) ? Usable : Remaining;
+	}
+	while(Remaining > 0);
+	
+	if(Remaining > 0)
+	{
+		for(int i = 0; i < Payload->NumCarriers; i++)
+			Carrier[Payload->Carrier[i]].Owner = -1;
+		Payload->NumCarriers = 0;
+		return -1;
+	}
+	
+	//Estimate with the uncompressed size, filling the carriers in order
+	Remaining = Payload->Size;
+	for(int i = 0; i < Payload->NumCarriers; i++)
+	{
+		Stored = (Carrier[Payload->Carrier[i]].Capacity < Remaining) ? Carrier[Payload->Carrier[i]].Capacity : Remaining;
+		*Rewritten += rewritten_bytes(&Carrier[Payload->Carrier[i]], Stored, Format);
+		Remaining -= Stored;
+	}
+	
+	return 0;
+}
+
+/******************************************************************************/
+//Read the headers of every carrier with NumWorkers threads
+static void scan_corpus(struct plan_state *State, int NumWorkers)
+{
+	pthread_t	*Worker;
+	int			NumStarted = 0;
+	
+	if(NumWorkers > State->NumCarriers)
+		NumWorkers = State->NumCarriers;
+	
+	Worker = malloc(((NumWorkers > 0) ? NumWorkers : 1) * sizeof(pthread_t));
+	if(Worker != NULL)
+	{
+		for(; NumStarted < NumWorkers; NumStarted++)
+		{
+			if(pthread_create(&Worker[NumStarted], NULL, scan_worker, State) != 0)
+				break;
+		}
+	}
+	
+	//Whatever the workers left is scanned here
+	scan_worker(State);
+	
+	for(int i = 0; i < NumStarted; i++)
+		pthread_join(Worker[i], NULL);
+	
+	free(Worker);
+}
+
+/******************************************************************************/
+//Write the plan as a batch manifest, payloads in the order they were given.
+//Returns -1 if the file can not be written.
+static int write_manifest(const char *ManifestName, const struct plan_payload *Plan, int NumPayloads,
+						  const struct plan_carrier *Carrier, const lsb_format_t *Format, uint8_t Compress,
+						  int NumPlaced, int NumTouched, uint64_t Rewritten)
+{
+	FILE	*Manifest;
+	
+	Manifest = fopen(ManifestName, "w");
+	if(Manifest == NULL)
+		return -1;
+	
+	fprintf(Manifest, "# %d of %d payload(s) on %d image(s), about %" PRIu64 " bytes rewritten\n", NumPlaced,
+			NumPayloads, NumTouched, Rewritten);
+	fprintf(Manifest, "# Run in batch mode with --bits=%d --channels=%s%s%s%s\n", Format->Bits,
+			(Format->Channels & LSB_RED) ? "R" : "", (Format->Channels & LSB_GREEN) ? "G" : "",
+			(Format->Channels & LSB_BLUE) ? "B" : "", Compress ? " --compress" : "");
+	
+	for(int p = 0; p < NumPayloads; p++)
+	{
+		if(Plan[p].NumCarriers == 1)
+		{
+			fprintf(Manifest, "c %s %s\n", Carrier[Plan[p].Carrier[0]].Path, Plan[p].Path);
+		}
+		else if(Plan[p].NumCarriers > 1)
+		{
+			fprintf(Manifest, "s %s", Plan[p].Path);
+			for(int i = 0; i < Plan[p].NumCarriers; i++)
+				fprintf(Manifest, " %s", Carrier[Plan[p].Carrier[i]].Path);
+			fprintf(Manifest, "\n");
+		}
+		else if(Plan[p].Readable)
+		{
+			fprintf(Manifest, "# not placed, not enough free capacity: %s (%" PRIu64 " bytes)\n", Plan[p].Path,
+					Plan[p].Size);
+		}
+	}
+	
+	return (fclose(Manifest) == 0) ? 0 : -1;
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Collect the corpus capacities, place the payloads and write the manifest
+int plan_run(const char *ManifestName, const char *CarrierPath, char **Payload, int NumPayloads,
+			 const lsb_format_t *Format, uint8_t Compress, int NumWorkers)
+{
+	struct plan_state		State;
+	struct plan_payload		*Plan;
+	struct stat				PayloadStat;
+	int						*Order;
+	int						NumFree = 0;
+	int						NumBusy = 0;
+	int						NumPlaced = 0;
+	int						NumTouched = 0;
+	uint64_t				FreeCapacity = 0;
+	uint64_t				Rewritten = 0;
+	int						Result = 0;
+	
+	memset(&State, 0, sizeof(State));
+	State.Format = Format;
+	pthread_mutex_init(&State.Lock, NULL);
+	
+	Plan = calloc(NumPayloads, sizeof(struct plan_payload));
+	Order = malloc(NumPayloads * sizeof(int));
+	
+	if((Plan == NULL) || (Order == NULL) || (collect_path(&State, CarrierPath) != 0))
+	{
+		printf("Could not allocate memory for the plan!\n");
+		Result = -1;
+	}
+	
+	//Payload files found in the corpus are not carriers
+	for(int p = 0; (Result == 0) && (p < NumPayloads); p++)
+	{
+		Plan[p].Path = Payload[p];
+		Order[p] = p;
+		
+		if((stat(Payload[p], &PayloadStat) != 0) || !S_ISREG(PayloadStat.st_mode))
+		{
+			printf("%s: could not be read\n", Payload[p]);
+			continue;
+		}
+		if(strpbrk(Payload[p], " \t\r\n#") != NULL)
+		{
+			printf("%s: blanks and '#' can not be written to a manifest\n", Payload[p]);
+			continue;
+		}
+		
+		Plan[p].Size = PayloadStat.st_size;
+		Plan[p].Readable = 1;
+		
+		for(int i = 0; i < State.NumCarriers; i++)
+		{
+			if((State.Carrier[i].Device == PayloadStat.st_dev) && (State.Carrier[i].Inode == PayloadStat.st_ino))
+				State.Carrier[i].Status = CARRIER_PAYLOAD;
+		}
+	}
+	
+	if(Result == 0)
+	{
+		scan_corpus(&State, NumWorkers);
+		qsort(State.Carrier, State.NumCarriers, sizeof(struct plan_carrier), compare_carriers);
+		
+		for(int i = 0; i < State.NumCarriers; i++)
+		{
+			if(State.Carrier[i].Status == CARRIER_FREE)
+			{
+				NumFree++;
+				FreeCapacity += State.Carrier[i].Capacity;
+			}
+			else if(State.Carrier[i].Status == CARRIER_BUSY)
+			{
+				NumBusy++;
+			}
+		}
+		
+		printf("%d file(s) scanned: %d free carrier(s) holding %" PRIu64 " payload bytes, %d already carrying a payload\n",
+			   State.NumCarriers, NumFree, FreeCapacity, NumBusy);
+		if(State.NumSkipped > 0)
+			printf("%d file(s) skipped, blanks and '#' can not be written to a manifest\n", State.NumSkipped);
+		
+		//Biggest payloads first
+		SortPayload = Plan;
+		qsort(Order, NumPayloads, sizeof(int), compare_payloads);
+		
+		for(int p = 0; p < NumPayloads; p++)
+		{
+			if(!Plan[Order[p]].Readable)
+				continue;
+			
+			if(place_payload(&Plan[Order[p]], Order[p], State.Carrier, NumFree, Compress, &Rewritten, Format) == 0)
+			{
+				NumPlaced++;
+				NumTouched += Plan[Order[p]].NumCarriers;
+			}
+		}
+		
+		if(write_manifest(ManifestName, Plan, NumPayloads, State.Carrier, Format, Compress, NumPlaced, NumTouched,
+						  Rewritten) != 0)
+		{
+			printf("Could not write manifest \"%s\"\n", ManifestName);
+			Result = -1;
+		}
+		else
+		{
+			printf("%d of %d payload(s) placed on %d image(s), about %" PRIu64 " bytes rewritten\n", NumPlaced,
+				   NumPayloads, NumTouched, Rewritten);
+			Result = NumPayloads - NumPlaced;
+		}
+	}
+	
+	for(int i = 0; i < State.NumCarriers; i++)
+		free(State.Carrier[i].Path);
+	for(int p = 0; (Plan != NULL) && (p < NumPayloads); p++)
+		free(Plan[p].Carrier);
+	
+	free(State.Carrier);
+	free(Plan);
+	free(Order);
+	pthread_mutex_destroy(&State.Lock);
+	
+	return Result;
+}
@@ -0,0 +1,43 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the capacity planner: assigns payloads to the      *
+ * carriers of a corpus and writes the batch manifest doing it       *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __PLAN_H__
+#define __PLAN_H__
+
+#include <stdint.h>
+
+#include "lsb.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//The plan is a batch manifest (batch.h): a payload that fits one carrier gets
+//a "c" line, one that fits none an "s" line over as few carriers as possible.
+//Carriers that already hold a payload are never used. Payloads that can not
+//be placed are listed as comments.
+
+//Carrier headers read at once when -j is not given. Reading headers waits on
+//the disk far more than on the CPU.
+#define PLAN_DEFAULT_WORKERS	16
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Collect the capacity of every image under CarrierPath (a directory is
+//searched recursively) with NumWorkers threads, reading headers only, then
+//assign the payloads with the density Format and write the manifest. With
+//Compress set payloads are planned at their worst case compressed size.
+//Returns the number of payloads not placed, or -1 on error.
+int plan_run(const char *ManifestName, const char *CarrierPath, char **Payload, int NumPayloads,
+			 const lsb_format_t *Format, uint8_t Compress, int NumWorkers);
+
+
+#endif
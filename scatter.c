@@ -0,0 +1,275 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the keyed scatter order: payload channel fields spread over	*
+ * the image by a counter based permutation										*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+#include "scatter.h"
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Work of one thread: a run of payload fields
+struct scatter_band
+{
+	img24_t *Img;
+	const scatter_t *Scatter;
+	uint8_t *Payload;					//Payload bytes of this band (starts byte aligned)
+	uint64_t FirstField;
+	uint64_t NumBits;
+	uint8_t Embed;						//1: embed, 0: extract
+};
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//splitmix64 finaliser, the Feistel round function
+static uint64_t mix(uint64_t Value)
+{
+	Value ^= Value >> 30;
+	Value *= 0xbf58476d1ce4e5b9ull;
+	Value ^= Value >> 27;
+	Value *= 0x94d049bb133111ebull;
+	Value ^= Value >> 31;
+	
+	return Value;
+}
+
+/******************************************************************************/
+//One pass of the Feistel network over [0, 2^(2 * HalfBits))
+static uint64_t feistel(const scatter_t *Scatter, uint64_t Value)
+{
+	uint64_t	Left = Value >> Scatter->HalfBits;
+	uint64_t	Right = Value & Scatter->HalfMask;
+	uint64_t	Next;
+	
+	for(int i = 0; i < SCATTER_ROUNDS; i++)
+	{
+		Next = Left ^ (mix(Right ^ Scatter->RoundKey[i]) & Scatter->HalfMask);
+		Left = Right;
+		Right = Next;
+	}
+	
+	return (Left << Scatter->HalfBits) | Right;
+}
+
+/******************************************************************************/
+//Store or recover the bits of a run of payload fields. Payload holds the bits
+//of the run from bit 0.
+static void scatter_fields(img24_t *Img, const scatter_t *Scatter, uint8_t *Payload, uint64_t FirstField,
+						   uint64_t NumBits, uint8_t Embed)
+{
+	uint64_t	RowSlots = LSB_ROW_SLOTS(Img);
+	unsigned	Bits = Scatter->Format.Bits;
+	uint64_t	Slot;
+	uint64_t	Bit = 0;
+	uint8_t		*Channel;
+	uint8_t		Old;
+	
+	//Extracted bits are ORed in
+	if(!Embed)
+	{
+		for(uint64_t i = 0; i < (NumBits + 7) / 8; i++)
+			Payload[i] = 0;
+	}
+	
+	for(uint64_t Field = FirstField; Bit < NumBits; Field++)
+	{
+		Slot = scatter_slot(Scatter, Field);
+		Channel = (uint8_t *)Img->Pixel[Slot / RowSlots] + LSB_SLOT_BYTE(&Img->Layout, Slot % RowSlots);
+		Old = *Channel;
+		
+		for(unsigned j = 0; (j < Bits) && (Bit < NumBits); j++, Bit++)
+		{
+			if(Embed)
+				*Channel = (*Channel & ~(1 << j)) | (((Payload[Bit >> 3] >> (Bit & 7)) & 1) << j);
+			else
+				Payload[Bit >> 3] |= ((*Channel >> j) & 1) << (Bit & 7);
+		}
+		
+		//Palette indexes take the nearest color with the other bit (see lsb.h)
+		if(Embed && (Img->Layout.BytesPerPixel == 1) && (*Channel != Old))
+			*Channel = Img->Layout.Nearest[Old];
+	}
+}
+
+/******************************************************************************/
+static void *run_band(void *Arg)
+{
+	struct scatter_band *Band = Arg;
+	
+	scatter_fields(Band->Img, Band->Scatter, Band->Payload, Band->FirstField, Band->NumBits, Band->Embed);
+	
+	return NULL;
+}
+
+/******************************************************************************/
+//Split the fields in runs of whole payload bytes (every 8 fields) and process
+//them on NumThreads threads. Fields are scattered, so no two threads touch the
+//same channel byte whatever the split.
+static void run_bands(img24_t *Img, const scatter_t *Scatter, uint8_t *Payload, uint64_t FirstBit,
+					  uint64_t NumBits, int NumThreads, uint8_t Embed)
+{
+	uint64_t			Bits = Scatter->Format.Bits;
+	uint64_t			NumFields = (NumBits + Bits - 1) / Bits;
+	uint64_t			BandStart = 0;
+	uint64_t			BandEnd;
+	struct scatter_band	*Band;
+	pthread_t			*Thread;
+	uint8_t				*Started;
+	
+	if(NumBits == 0)
+		return;
+	
+	//Not worth a thread per band for small payloads
+	if(NumBits < LSB_MIN_BITS_PER_THREAD * (uint64_t)NumThreads)
+		NumThreads = 1 + NumBits / LSB_MIN_BITS_PER_THREAD;
+	
+	Band = malloc(NumThreads * sizeof(struct scatter_band));
+	Thread = malloc(NumThreads * sizeof(pthread_t));
+	Started = calloc(NumThreads, 1);
+	if((Band == NULL) || (Thread == NULL) || (Started == NULL))
+	{
+		printf("Error: could not allocate memory for worker threads\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(int i = 0; i < NumThreads; i++)
+	{
+		BandEnd = (i == NumThreads - 1) ? NumFields : (NumFields * (i + 1) / NumThreads) & ~((uint64_t)7);
+		if(BandEnd < BandStart)
+			BandEnd = BandStart;
+		
+		Band[i].Img = Img;
+		Band[i].Scatter = Scatter;
+		Band[i].Payload = Payload + (BandStart * Bits >> 3);
+		Band[i].FirstField = FirstBit / Bits + BandStart;
+		Band[i].NumBits = ((BandEnd * Bits < NumBits) ? BandEnd * Bits : NumBits) - BandStart * Bits;
+		Band[i].Embed = Embed;
+		
+		BandStart = BandEnd;
+		
+		//Last band runs on the calling thread, as does any band whose thread
+		//could not be created
+		if((i < NumThreads - 1) && (Band[i].NumBits > 0))
+			Started[i] = (pthread_create(&Thread[i], NULL, run_band, &Band[i]) == 0);
+		
+		if(!Started[i])
+			run_band(&Band[i]);
+	}
+	
+	for(int i = 0; i < NumThreads; i++)
+	{
+		if(Started[i])
+			pthread_join(Thread[i], NULL);
+	}
+	
+	free(Band);
+	free(Thread);
+	free(Started);
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//64 bit FNV-1a of the passphrase, mixed
+uint64_t scatter_key(const char *Passphrase)
+{
+	uint64_t Hash = 14695981039346656037ull;
+	
+	for(const char *Letter = Passphrase; *Letter != '\0'; Letter++)
+	{
+		Hash ^= (uint8_t)*Letter;
+		Hash *= 1099511628211ull;
+	}
+	
+	return mix(Hash);
+}
+
+/******************************************************************************/
+//Key check value, unrelated to the round keys
+uint32_t scatter_key_check(uint64_t Key)
+{
+	return mix(Key ^ 0x6b65792d63686b21ull) >> 32;
+}
+
+/******************************************************************************/
+//Permutation of the fields of an image
+void scatter_init(scatter_t *Scatter, uint64_t Key, const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumSlots)
+{
+	Scatter->Format = *Format;
+	Scatter->NumFields = (NumSlots > FirstSlot) ? lsb_format_bits(Format, FirstSlot, NumSlots - FirstSlot) / Format->Bits : 0;
+	
+	//Halves wide enough for every field, at least one bit each
+	Scatter->HalfBits = 1;
+	while((Scatter->HalfBits < 32) && ((1ull << (2 * Scatter->HalfBits)) < Scatter->NumFields))
+		Scatter->HalfBits++;
+	Scatter->HalfMask = (1ull << Scatter->HalfBits) - 1;
+	
+	for(int i = 0; i < SCATTER_ROUNDS; i++)
+		Scatter->RoundKey[i] = mix(Key + (i + 1) * 0x9e3779b97f4a7c15ull);
+	
+	//Fields are numbered in slot order: those left in the pixel of FirstSlot,
+	//then PixelFields per whole pixel
+	Scatter->NumLead = 0;
+	for(Scatter->PixelSlot = FirstSlot; Scatter->PixelSlot % 3 != 0; Scatter->PixelSlot++)
+	{
+		if(Format->Channels & (1 << (Scatter->PixelSlot % 3)))
+			Scatter->LeadSlot[Scatter->NumLead++] = Scatter->PixelSlot;
+	}
+	
+	Scatter->PixelFields = 0;
+	for(unsigned Channel = 0; Channel < 3; Channel++)
+	{
+		if(Format->Channels & (1 << Channel))
+			Scatter->Offset[Scatter->PixelFields++] = Channel;
+	}
+}
+
+/******************************************************************************/
+//Slot of a payload field, walking the cycle until it lands on a field
+uint64_t scatter_slot(const scatter_t *Scatter, uint64_t Field)
+{
+	do
+	{
+		Field = feistel(Scatter, Field);
+	}
+	while(Field >= Scatter->NumFields);
+	
+	if(Field < Scatter->NumLead)
+		return Scatter->LeadSlot[Field];
+	
+	Field -= Scatter->NumLead;
+	return Scatter->PixelSlot + Field / Scatter->PixelFields * 3 + Scatter->Offset[Field % Scatter->PixelFields];
+}
+
+/******************************************************************************/
+//Store payload bits in their scattered fields
+void scatter_embed_img(img24_t *Img, const scatter_t *Scatter, const uint8_t *Payload, uint64_t FirstBit,
+					   uint64_t NumBits, int NumThreads)
+{
+	run_bands(Img, Scatter, (uint8_t *)Payload, FirstBit, NumBits, NumThreads, 1);
+}
+
+/******************************************************************************/
+//Recover payload bits from their scattered fields
+void scatter_extract_img(const img24_t *Img, const scatter_t *Scatter, uint8_t *Payload, uint64_t FirstBit,
+						 uint64_t NumBits, int NumThreads)
+{
+	run_bands((img24_t *)Img, Scatter, Payload, FirstBit, NumBits, NumThreads, 0);
+}
@@ -0,0 +1,81 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the keyed scatter order: payload channel fields    *
+ * spread over the image by a counter based permutation              *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __SCATTER_H__
+#define __SCATTER_H__
+
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//The channel fields of an image (Format.Bits bits in each channel slot the
+//format uses) are numbered in slot order. Payload field N is stored in field
+//P(N), P being a keyed Feistel network over the smallest even power of two
+//holding every field, walked again while it lands past the last field. Any
+//field is placed on its own, with no table, so threads and random access work
+//as in the sequential order. This hides the order, it does not encrypt.
+
+//Feistel rounds
+#define SCATTER_ROUNDS		6
+
+/*******************************************************************************
+ *                                   STRUCTURES                                *
+ *******************************************************************************/
+
+//Permutation of the fields of one image
+struct scatter
+{
+	lsb_format_t Format;
+	uint64_t NumFields;					//Fields from the first slot to the image end
+	unsigned HalfBits;					//Width of a Feistel half
+	uint64_t HalfMask;
+	uint64_t RoundKey[SCATTER_ROUNDS];
+	uint64_t LeadSlot[2];				//Fields before the first whole pixel
+	unsigned NumLead;
+	uint64_t PixelSlot;					//First slot of the first whole pixel
+	uint8_t Offset[3];					//Channel of each field within a pixel
+	unsigned PixelFields;
+};
+
+typedef struct scatter				scatter_t;
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//64 bit key from a passphrase
+uint64_t scatter_key(const char *Passphrase);
+//------------------------------------------------------------------------------
+//Value stored with a scattered payload to tell a wrong key from a damaged one
+uint32_t scatter_key_check(uint64_t Key);
+//------------------------------------------------------------------------------
+//Permutation of the fields of Format from channel slot FirstSlot to slot
+//NumSlots (the image end)
+void scatter_init(scatter_t *Scatter, uint64_t Key, const lsb_format_t *Format, uint64_t FirstSlot, uint64_t NumSlots);
+//------------------------------------------------------------------------------
+//Channel slot holding payload field Field
+uint64_t scatter_slot(const scatter_t *Scatter, uint64_t Field);
+//------------------------------------------------------------------------------
+//Store payload bits [FirstBit, FirstBit + NumBits) in their scattered fields,
+//on NumThreads threads. Payload starts at bit FirstBit, which must be a
+//multiple of Format.Bits.
+void scatter_embed_img(img24_t *Img, const scatter_t *Scatter, const uint8_t *Payload, uint64_t FirstBit,
+					   uint64_t NumBits, int NumThreads);
+//------------------------------------------------------------------------------
+//Recover payload bits stored by scatter_embed_img()
+void scatter_extract_img(const img24_t *Img, const scatter_t *Scatter, uint8_t *Payload, uint64_t FirstBit,
+						 uint64_t NumBits, int NumThreads);
+
+
+#endif
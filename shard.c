@@ -0,0 +1,459 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of payload sharding: one payload split across an ordered set of	*
+ * carrier images																*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+#include "payload.h"
+#include "compress.h"
+#include "shard.h"
+
+
+/*******************************************************************************
+ *                              STATIC VARIABLES                               *
+ *******************************************************************************/
+
+//Where one shard comes from and where it goes
+struct shard_plan
+{
+	const char *Carrier;
+	uint64_t Offset;					//Offset in the (uncompressed) payload
+	uint64_t OriginalLength;			//Payload bytes in the shard
+	uint64_t Source;					//Offset of the stored bytes in the source file
+	uint64_t Length;					//Bytes stored in the carrier
+};
+
+//Shared by the extraction workers
+struct shard_state
+{
+	char **Carrier;
+	payload_header_t *Header;			//Header of each carrier
+	const char *OutputName;
+	int NumCarriers;
+	int Next;							//Next carrier to be taken by a worker
+	int Failed;
+	pthread_mutex_t Lock;
+};
+
+
+/*******************************************************************************
+ *                          STATIC FUNCTION DEFINITIONS                        *
+ *******************************************************************************/
+
+//Plan the compressed shards: payload blocks are compressed one by one into
+//Packed and added to the current shard while they fit. A block that does not
+//fit is cut to what is left of the carrier, raw blocks being at most 4 bytes
+//bigger than their input. Returns the number of shards or -1.
+static int plan_compressed(FILE *Payload, uint64_t PayloadSize, FILE *Packed, const uint64_t *Capacity,
+						   int NumCarriers, struct shard_plan *Plan)
+{
+	uint8_t		*Block = malloc(COMPRESS_BLOCK_SIZE);
+	uint8_t		*Output = malloc(COMPRESS_BOUND(COMPRESS_BLOCK_SIZE));
+	uint64_t	Offset = 0;
+	uint64_t	Stored = 0;
+	uint64_t	Take;
+	uint64_t	Size;
+	int			Shard = 0;
+	int			Result = 0;
+	
+	if((Block == NULL) || (Output == NULL))
+		Result = -1;
+	
+	while((Result == 0) && (Offset < PayloadSize))
+	{
+		if(Shard == NumCarriers)
+		{
+			Result = -1;
+			break;
+		}
+		
+		Take = (PayloadSize - Offset < COMPRESS_BLOCK_SIZE) ? (PayloadSize - Offset) : COMPRESS_BLOCK_SIZE;
+		if((fseeko(Payload, Offset, SEEK_SET) != 0) || (fread(Block, 1, Take, Payload) != Take))
+		{
+			Result = -1;
+			break;
+		}
+		
+		Size = compress_buffer(Block, Take, Output);
+		if(Plan[Shard].Length + Size > Capacity[Shard])
+		{
+			if(Capacity[Shard] - Plan[Shard].Length > COMPRESS_BLOCK_HEADER)
+			{
+				Take = Capacity[Shard] - Plan[Shard].Length - COMPRESS_BLOCK_HEADER;
+				Size = compress_buffer(Block, Take, Output);
+			}
+			else
+			{
+				//Carrier is full, next one
+				Shard++;
+				if(Shard < NumCarriers)
+				{
+					Plan[Shard].Offset = Offset;
+					Plan[Shard].Source = Stored;
+				}
+				continue;
+			}
+		}
+		
+		if(fwrite(Output, 1, Size, Packed) != Size)
+		{
+			Result = -1;
+			break;
+		}
+		
+		Plan[Shard].OriginalLength += Take;
+		Plan[Shard].Length += Size;
+		Offset += Take;
+		Stored += Size;
+	}
+	
+	free(Block);
+	free(Output);
+	
+	if(Result != 0)
+		return -1;
+	
+	//Carrier left empty when the payload ended with the previous one
+	return ((Shard < NumCarriers) && (Plan[Shard].Length > 0)) ? Shard + 1 : Shard;
+}
+
+/******************************************************************************/
+//Plan the raw shards: every carrier filled up to its capacity
+static int plan_raw(uint64_t PayloadSize, const uint64_t *Capacity, int NumCarriers, struct shard_plan *Plan)
+{
+	uint64_t	Offset = 0;
+	int			Shard;
+	
+	for(Shard = 0; (Shard < NumCarriers) && (Offset < PayloadSize); Shard++)
+	{
+		Plan[Shard].Offset = Offset;
+		Plan[Shard].Source = Offset;
+		Plan[Shard].Length = (PayloadSize - Offset < Capacity[Shard]) ? (PayloadSize - Offset) : Capacity[Shard];
+		Plan[Shard].OriginalLength = Plan[Shard].Length;
+		Offset += Plan[Shard].Length;
+	}
+	
+	return (Offset < PayloadSize) ? -1 : Shard;
+}
+
+/******************************************************************************/
+//Extraction worker: carriers are taken one by one, every shard is written at
+//its offset through its own file handle
+static void *extract_worker(void *Arg)
+{
+	struct shard_state	*State = Arg;
+	img24_t				*Img;
+	FILE				*Output;
+	int					Index;
+	int					Result;
+	int					Failed = 0;
+	
+	while(1)
+	{
+		pthread_mutex_lock(&State->Lock);
+		Index = (!State->Failed && (State->Next < State->NumCarriers)) ? State->Next++ : -1;
+		pthread_mutex_unlock(&State->Lock);
+		
+		if(Index < 0)
+			break;
+		
+		Result = try_map_BMP(State->Carrier[Index], 0, &Img);
+		if(Result != BMP_OK)
+		{
+			printf("%s: %s\n", State->Carrier[Index], bmp_error(Result));
+			Failed = 1;
+		}
+		else
+		{
+			Output = fopen(State->OutputName, "r+b");
+			if((Output == NULL) || (fseeko(Output, State->Header[Index].ShardOffset, SEEK_SET) != 0))
+				Result = PAYLOAD_READ_ERROR;
+			else
+				Result = payload_extract_file(Img, &State->Header[Index], Output, 1, NULL);
+			
+			if(Result != PAYLOAD_OK)
+			{
+				printf("%s: could not extract shard, %s\n", State->Carrier[Index], payload_error(Result));
+				Failed = 1;
+			}
+			
+			if((Output != NULL) && (fclose(Output) != 0))
+				Failed = 1;
+			
+			free_img(Img);
+		}
+		
+		//Stop handing out carriers once a shard failed
+		if(Failed)
+		{
+			pthread_mutex_lock(&State->Lock);
+			State->Failed = 1;
+			pthread_mutex_unlock(&State->Lock);
+		}
+	}
+	
+	return NULL;
+}
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Split a payload file across carriers
+int shard_embed(const char *PayloadName, char **Carrier, int NumCarriers, const lsb_format_t *Format,
+				uint8_t Compress, int NumThreads)
+{
+	struct shard_plan	*Plan;
+	payload_header_t	Header;
+	dimensions_t		Dimension;
+	uint64_t			*Capacity;
+	uint64_t			PayloadSize;
+	uint8_t				*Buffer = NULL;
+	uint8_t				*Resized;
+	img24_t				*Img;
+	FILE				*Payload;
+	FILE				*Source;
+	FILE				*Packed = NULL;
+	FILE				*Image;
+	int					NumShards = 0;
+	int					Failed = 0;
+	int					Result;
+	
+	if(NumCarriers > SHARD_MAX_COUNT)
+	{
+		printf("Too many carriers (%d at most)!\n", SHARD_MAX_COUNT);
+		return -1;
+	}
+	
+	Payload = fopen(PayloadName, "rb");
+	if(Payload == NULL)
+	{
+		printf("Could not open payload file!\n");
+		return -1;
+	}
+	
+	fseeko(Payload, 0, SEEK_END);
+	PayloadSize = ftello(Payload);
+	
+	Plan = calloc(NumCarriers, sizeof(struct shard_plan));
+	Capacity = malloc(NumCarriers * sizeof(uint64_t));
+	if((Plan == NULL) || (Capacity == NULL))
+	{
+		printf("Could not allocate memory for the shard plan!\n");
+		Failed = 1;
+	}
+	
+	//Capacities from the headers only, nothing is written before the plan is done
+	for(int i = 0; (Failed == 0) && (i < NumCarriers); i++)
+	{
+		Image = fopen(Carrier[i], "rb");
+		Result = (Image != NULL) ? read_dimensions_BMP(Image, &Dimension) : BMP_ERROR_READ;
+		if(Image != NULL)
+			fclose(Image);
+		
+		if((Result == BMP_OK) && !BMP_CAN_CARRY(&Dimension))
+			Result = BMP_ERROR_FORMAT;
+		if(Result != BMP_OK)
+		{
+			printf("%s: %s\n", Carrier[i], bmp_error(Result));
+			Failed = 1;
+		}
+		else if(!lsb_format_fits_layout(Format, &Dimension.Layout))
+		{
+			printf("%s: palette images take 1 bit per palette index only (no --bits or --channels)\n", Carrier[i]);
+			Failed = 1;
+		}
+		else
+		{
+			Capacity[i] = payload_capacity(LSB_IMG_SLOTS(&Dimension), Format);
+		}
+	}
+	
+	if((Failed == 0) && Compress)
+	{
+		Packed = tmpfile();
+		NumShards = (Packed != NULL) ? plan_compressed(Payload, PayloadSize, Packed, Capacity, NumCarriers, Plan) : -1;
+	}
+	else if(Failed == 0)
+	{
+		NumShards = plan_raw(PayloadSize, Capacity, NumCarriers, Plan);
+	}
+	
+	if(NumShards < 0)
+	{
+		printf("Payload does not fit in the carriers given!\n");
+		Failed = 1;
+	}
+	
+	//An empty payload still gets its (empty) shard
+	if((Failed == 0) && (NumShards == 0))
+		NumShards = 1;
+	
+	//Stored bytes come from the payload, or from the compressed copy
+	Source = Compress ? Packed : Payload;
+	
+	for(int i = 0; (Failed == 0) && (i < NumShards); i++)
+	{
+		Resized = realloc(Buffer, Plan[i].Length + 1);
+		if(Resized != NULL)
+			Buffer = Resized;
+		if((Resized == NULL) || (fseeko(Source, Plan[i].Source, SEEK_SET) != 0) ||
+		   (fread(Buffer, 1, Plan[i].Length, Source) != Plan[i].Length))
+		{
+			printf("Could not read payload file!\n");
+			Failed = 1;
+			continue;
+		}
+		
+		payload_make_header(&Header, Plan[i].Length, Format);
+		if(Compress)
+			Header.Flags |= PAYLOAD_COMPRESSED;
+		Header.OriginalLength = Plan[i].OriginalLength;
+		Header.ShardIndex = i;
+		Header.ShardCount = NumShards;
+		Header.ShardOffset = Plan[i].Offset;
+		payload_seal_header(&Header);
+		
+		Result = try_map_BMP(Carrier[i], 1, &Img);
+		if(Result != BMP_OK)
+		{
+			printf("%s: %s\n", Carrier[i], bmp_error(Result));
+			Failed = 1;
+			continue;
+		}
+		
+		payload_embed_img(Img, &Header, Buffer, NumThreads);
+		free_img(Img);
+		
+		printf("%s: shard %d/%d, payload bytes [%" PRIu64 ", %" PRIu64 ")\n", Carrier[i], i + 1, NumShards,
+			   Plan[i].Offset, Plan[i].Offset + Plan[i].OriginalLength);
+	}
+	
+	for(int i = NumShards; (Failed == 0) && (i < NumCarriers); i++)
+		printf("%s: not needed, left untouched\n", Carrier[i]);
+	
+	fclose(Payload);
+	if(Packed != NULL)
+		fclose(Packed);
+	free(Buffer);
+	free(Plan);
+	free(Capacity);
+	
+	return (Failed == 0) ? 0 : -1;
+}
+
+/******************************************************************************/
+//Rebuild a payload file from its shards
+int shard_extract(const char *OutputName, char **Carrier, int NumCarriers, int NumWorkers)
+{
+	struct shard_state	State;
+	payload_header_t	**ByIndex;
+	pthread_t			*Thread;
+	FILE				*Output;
+	uint64_t			Offset = 0;
+	int					NumStarted = 0;
+	int					Count;
+	int					Result;
+	
+	State.Carrier = Carrier;
+	State.NumCarriers = NumCarriers;
+	State.OutputName = OutputName;
+	State.Next = 0;
+	State.Failed = 0;
+	State.Header = malloc(NumCarriers * sizeof(payload_header_t));
+	ByIndex = calloc(NumCarriers, sizeof(payload_header_t *));
+	if((State.Header == NULL) || (ByIndex == NULL))
+	{
+		printf("Could not allocate memory for shard headers!\n");
+		return -1;
+	}
+	
+	//Headers first: the set must be complete and consistent before writing
+	for(int i = 0; i < NumCarriers; i++)
+	{
+		Result = payload_probe(Carrier[i], &State.Header[i]);
+		if(Result == PAYLOAD_OK)
+			Result = payload_check_key(&State.Header[i]);
+		if(Result != PAYLOAD_OK)
+		{
+			printf("%s: %s\n", Carrier[i], payload_error(Result));
+			return -1;
+		}
+		
+		//A payload that is not sharded is a set of one
+		Count = (State.Header[i].ShardCount > 0) ? State.Header[i].ShardCount : 1;
+		if((Count != NumCarriers) || (State.Header[i].ShardIndex >= NumCarriers) ||
+		   (ByIndex[State.Header[i].ShardIndex] != NULL))
+		{
+			printf("%s: shard %d/%d does not belong with the %d images given\n", Carrier[i],
+				   State.Header[i].ShardIndex + 1, Count, NumCarriers);
+			return -1;
+		}
+		
+		ByIndex[State.Header[i].ShardIndex] = &State.Header[i];
+	}
+	
+	for(int i = 0; i < NumCarriers; i++)
+	{
+		if(ByIndex[i]->ShardOffset != Offset)
+		{
+			printf("Shards do not cover the payload (shard %d starts at byte %" PRIu64 ", expected %" PRIu64 ")\n",
+				   i + 1, ByIndex[i]->ShardOffset, Offset);
+			return -1;
+		}
+		Offset += (ByIndex[i]->Flags & PAYLOAD_COMPRESSED) ? ByIndex[i]->OriginalLength : ByIndex[i]->Length;
+	}
+	
+	Output = fopen(OutputName, "wb");
+	if((Output == NULL) || (fclose(Output) != 0))
+	{
+		printf("Could not open payload file!\n");
+		return -1;
+	}
+	
+	pthread_mutex_init(&State.Lock, NULL);
+	
+	if(NumWorkers > NumCarriers)
+		NumWorkers = NumCarriers;
+	
+	Thread = malloc(NumWorkers * sizeof(pthread_t));
+	if(Thread != NULL)
+	{
+		for(int i = 0; i < NumWorkers; i++)
+		{
+			if(pthread_create(&Thread[NumStarted], NULL, extract_worker, &State) == 0)
+				NumStarted++;
+		}
+	}
+	
+	//Without any worker thread the shards are read on the calling thread
+	if(NumStarted == 0)
+		extract_worker(&State);
+	
+	for(int i = 0; i < NumStarted; i++)
+		pthread_join(Thread[i], NULL);
+	
+	pthread_mutex_destroy(&State.Lock);
+	free(Thread);
+	free(State.Header);
+	free(ByIndex);
+	
+	if(State.Failed)
+		return -1;
+	
+	printf("%d shards joined, %" PRIu64 " bytes\n", NumCarriers, Offset);
+	
+	return 0;
+}
@@ -0,0 +1,45 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of payload sharding: one payload split across an      *
+ * ordered set of carrier images                                     *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <stdint.h>
+
+#include "lsb.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Every shard is a complete container: its header records the shard index, the
+//number of shards and the offset of the shard in the whole payload. A
+//compressed shard holds whole compressed blocks, so each shard is
+//decompressed on its own and the offset refers to the uncompressed payload.
+
+//Most shards in one set (ShardIndex and ShardCount are 16 bits)
+#define SHARD_MAX_COUNT		65535
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Split the payload file across the carriers, in order, filling each one before
+//moving on. Carriers are patched in place, those not needed are left as they
+//are. Nothing is written if the payload does not fit. Returns 0 on success.
+int shard_embed(const char *PayloadName, char **Carrier, int NumCarriers, const lsb_format_t *Format,
+				uint8_t Compress, int NumThreads);
+//------------------------------------------------------------------------------
+//Rebuild the payload file from its shards, given in any order. NumWorkers
+//carriers are read at once, each shard written at its own offset. Returns 0
+//on success.
+int shard_extract(const char *OutputName, char **Carrier, int NumCarriers, int NumWorkers);
+
+
+#endif
@@ -0,0 +1,199 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **
+ * Source code of the streaming (constant memory) steganography pipeline		*
+ *																				*
+ * Autor: Vitor Henrique Andrade Helfensteller Satraggiotti Silva				*
+ * Start date: 18/10/2026														*
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "lsb.h"
+#include "stream.h"
+
+
+/*******************************************************************************
+ *                              FUNCTION DEFINITIONS                           *
+ *******************************************************************************/
+
+//Attach payload while copying the image one block of rows at a time
+void stream_embed(const char *InputName, const char *OutputName, const payload_header_t *Header,
+				  FILE *Payload, uint64_t PayloadSize, size_t WindowSize)
+{
+	dimensions_t	Dimension;
+	FILE			*Input;
+	FILE			*Output;
+	
+	uint8_t			*Block;
+	uint8_t			*PayloadChunk;
+	size_t			BlockSize;
+	size_t			Count;
+	
+	uint32_t		Stride;
+	uint64_t		RowSlots;
+	lsb_format_t	Format = payload_format(Header);
+	lsb_format_t	HeaderFormat = {1, LSB_ALL_CHANNELS};
+	uint64_t		EndSlot = payload_end_slot(Header);
+	uint64_t		Rows;
+	int32_t			RowsPerBlock;
+	int32_t			NumRows;
+	int32_t			FirstRow;
+	int32_t			Row;
+	
+	uint64_t		FirstByte;
+	uint64_t		EndByte;
+	uint64_t		BlockFirstSlot;
+	uint64_t		Slot;
+	uint64_t		RowEndSlot;
+	uint64_t		FirstBit;
+	uint64_t		NumBits;
+	
+	Dimension = dimensions_BMP(InputName);
+	if(!BMP_CAN_CARRY(&Dimension))
+	{
+		printf("Error: %s\n\n", bmp_error(BMP_ERROR_FORMAT));
+		exit(EXIT_FAILURE);
+	}
+	
+	Stride = Dimension.Stride;
+	RowSlots = LSB_ROW_SLOTS(&Dimension);
+	
+	//Window holds whole rows, at least one and at most the image. Clamped
+	//before narrowing, as a big window gives more rows than 32 bits hold
+	Rows = WindowSize / Stride;
+	if(Rows < 1)
+		Rows = 1;
+	if(Rows > (uint64_t)Dimension.Height)
+		Rows = Dimension.Height;
+	RowsPerBlock = Rows;
+	
+	BlockSize = (size_t)RowsPerBlock * Stride;
+	if(BlockSize < Dimension.OffsetPixelMatrix)
+		BlockSize = Dimension.OffsetPixelMatrix;
+	
+	Block = malloc(BlockSize);
+	PayloadChunk = malloc(RowsPerBlock * RowSlots * Format.Bits / 8 + 2);
+	if((Block == NULL) || (PayloadChunk == NULL))
+	{
+		printf("Error: could not allocate memory for streaming window\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	Input = fopen(InputName, "rb");
+	Output = fopen(OutputName, "wb");
+	if((Input == NULL) || (Output == NULL))
+	{
+		printf("Error: problem ocurred while opening image files for streaming\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	//Headers are copied untouched (all header versions are kept)
+	if((fread(Block, 1, Dimension.OffsetPixelMatrix, Input) != Dimension.OffsetPixelMatrix) ||
+	   (fwrite(Block, 1, Dimension.OffsetPixelMatrix, Output) != Dimension.OffsetPixelMatrix))
+	{
+		printf("Error: problem ocurred while copying image headers\n\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	//Pixel matrix, one block of rows at a time in file order
+	for(int32_t FileRow = 0; FileRow < Dimension.Height; FileRow += NumRows)
+	{
+		NumRows = Dimension.Height - FileRow;
+		if(NumRows > RowsPerBlock)
+			NumRows = RowsPerBlock;
+		
+		if(fread(Block, Stride, NumRows, Input) != (size_t)NumRows)
+		{
+			printf("Error: image file is truncated (pixel matrix ends at row %d)\n\n", FileRow);
+			exit(EXIT_FAILURE);
+		}
+		
+		//Image rows (row 0 at the bottom) held by this block. They are contiguous,
+		//in reverse order for top-down files
+		FirstRow = Dimension.TopDown ? (Dimension.Height - FileRow - NumRows) : FileRow;
+		
+		BlockFirstSlot = (uint64_t)FirstRow * RowSlots;
+		
+		if(BlockFirstSlot < EndSlot)
+		{
+			//Payload bytes needed by the block (slots after the container header)
+			FirstByte = 0;
+			EndByte = 0;
+			if(BlockFirstSlot + NumRows * RowSlots > PAYLOAD_HEADER_SLOTS)
+			{
+				if(BlockFirstSlot > PAYLOAD_HEADER_SLOTS)
+					FirstByte = lsb_format_bits(&Format, PAYLOAD_HEADER_SLOTS, BlockFirstSlot - PAYLOAD_HEADER_SLOTS) >> 3;
+				EndByte = (lsb_format_bits(&Format, PAYLOAD_HEADER_SLOTS,
+										   BlockFirstSlot + NumRows * RowSlots - PAYLOAD_HEADER_SLOTS) + 7) >> 3;
+				if(EndByte > PayloadSize)
+					EndByte = PayloadSize;
+			}
+			
+			if((EndByte > FirstByte) &&
+			   ((fseeko(Payload, FirstByte, SEEK_SET) != 0) ||
+				(fread(PayloadChunk, 1, EndByte - FirstByte, Payload) != EndByte - FirstByte)))
+			{
+				printf("Error: could not read payload file\n\n");
+				exit(EXIT_FAILURE);
+			}
+			
+			for(int32_t BlockRow = 0; BlockRow < NumRows; BlockRow++)
+			{
+				Row = Dimension.TopDown ? (FirstRow + NumRows - 1 - BlockRow) : (FirstRow + BlockRow);
+				Slot = (uint64_t)Row * RowSlots;
+				RowEndSlot = Slot + RowSlots;
+				if(RowEndSlot > EndSlot)
+					RowEndSlot = EndSlot;
+				
+				//Container header part of the row
+				if(Slot < PAYLOAD_HEADER_SLOTS)
+				{
+					Count = ((RowEndSlot < PAYLOAD_HEADER_SLOTS) ? RowEndSlot : PAYLOAD_HEADER_SLOTS) - Slot;
+					lsb_embed_row(Block + (size_t)BlockRow * Stride, &Dimension.Layout, 0, Count, Slot % 3,
+								  &HeaderFormat, (const uint8_t *)Header, Slot, Count);
+					Slot += Count;
+				}
+				
+				//Payload part of the row
+				if(Slot < RowEndSlot)
+				{
+					FirstBit = lsb_format_bits(&Format, PAYLOAD_HEADER_SLOTS, Slot - PAYLOAD_HEADER_SLOTS);
+					NumBits = lsb_format_bits(&Format, Slot, RowEndSlot - Slot);
+					if(NumBits > PayloadSize * 8 - FirstBit)
+						NumBits = PayloadSize * 8 - FirstBit;
+					
+					lsb_embed_row(Block + (size_t)BlockRow * Stride, &Dimension.Layout, Slot - (uint64_t)Row * RowSlots,
+								  RowEndSlot - Slot, Slot % 3, &Format, PayloadChunk, FirstBit - FirstByte * 8, NumBits);
+				}
+			}
+		}
+		
+		if(fwrite(Block, Stride, NumRows, Output) != (size_t)NumRows)
+		{
+			printf("Error: problem ocurred while writing image file\n\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	//Anything stored after the pixel matrix (e.g. V5 color profile) is kept
+	while((Count = fread(Block, 1, BlockSize, Input)) > 0)
+	{
+		if(fwrite(Block, 1, Count, Output) != Count)
+		{
+			printf("Error: problem ocurred while writing image file\n\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	if(fclose(Output) != 0)
+	{
+		printf("Error: problem ocurred while writing image file\n\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(Input);
+	
+	free(Block);
+	free(PayloadChunk);
+}
@@ -0,0 +1,39 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Header file of the streaming (constant memory) steganography      *
+ * pipeline for BMP images of any size                               *
+ *                                                                   *
+ * Author: Vitor Henrique Andrade Helfensteller Straggiotti Silva    *
+ * Created on: 18/10/2026 (DD/MM/YYYY)                               *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "payload.h"
+
+/*******************************************************************************
+ *                            MACROS AND TYPEDEF                               *
+ *******************************************************************************/
+
+//Default amount of pixel matrix held in memory at once (bytes)
+#define STREAM_DEFAULT_WINDOW	(8 << 20)
+
+/*******************************************************************************
+ *                                  FUNCTIONS                                  *
+ *******************************************************************************/
+
+//------------------------------------------------------------------------------
+//Copy image InputName to OutputName with the container Header and PayloadSize
+//bytes of Payload attached. The pixel matrix goes through memory one block of
+//rows (at most WindowSize bytes) at a time, headers and any data after the
+//pixel matrix are copied as is, pixels keep their format. Header must not be
+//scattered.
+void stream_embed(const char *InputName, const char *OutputName, const payload_header_t *Header,
+				  FILE *Payload, uint64_t PayloadSize, size_t WindowSize);
+
+
+#endif